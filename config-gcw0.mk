@@ -1,8 +1,15 @@
 GC_FUNCTIONS = True
 # USE_SERIAL = True
 # BKLIGHT_ON = True
+# USE_BOOTBENCH = True
+# USE_WARMBOOT = True
+# USE_CACHED_LOAD = True
+# USE_STAGE2 = True
+# USE_RESUME = True
+# USE_CACHE_RAM = True
 # USE_NAND = True
 # USE_UBI = True
+# USE_FIT = True
 
 BOARD := gcw0
 
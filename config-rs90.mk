@@ -1,8 +1,17 @@
 GC_FUNCTIONS = True
 USE_SERIAL = True
 # BKLIGHT_ON = True
+# USE_BOOTBENCH = True
+# USE_WARMBOOT = True
+# USE_CACHED_LOAD = True
+# USE_STAGE2 = True
+# USE_RESUME = True
 USE_NAND = True
+# USE_NAND_ONFI = True
 USE_UBI = True
+# USE_UBI_FASTMAP = True
+# USE_UBI_INITRD = True
+# USE_UBI_FDT = True
 
 BOARD := rs90
 
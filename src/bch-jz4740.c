@@ -36,15 +36,18 @@ static void rs_correct(unsigned char *dat, int idx, int mask)
 		dat[i+1] ^= (mask >> 8) & 0xff;
 }
 
+void bch_start_block(void)
+{
+	/* Enable RS decoding; the data is then picked up from the bus */
+	REG_EMC_NFINTS = 0x0;
+	__nand_ecc_rs_decoding();
+}
+
 int bch_correct_block(uint8_t *dst, uint8_t *oobbuf)
 {
 	volatile unsigned char *paraddr = (volatile unsigned char *)EMC_NFPAR0;
 	unsigned int i, stat;
 
-	/* Enable RS decoding */
-	REG_EMC_NFINTS = 0x0;
-	__nand_ecc_rs_decoding();
-
 	/* Set PAR values */
 	for (i = 0; i < PAR_SIZE; i++)
 		*paraddr++ = oobbuf[i];
@@ -64,9 +67,6 @@ int bch_correct_block(uint8_t *dst, uint8_t *oobbuf)
 		unsigned int errcnt, index, mask;
 
 		if (stat & EMC_NFINTS_UNCOR) {
-			/* XXX: Why is that appearing all the time, and the
-			 * kernel still boots fine? */
-
 			SERIAL_ERR(ERR_NAND_IO_UNC);
 			return 0;
 		}
@@ -13,13 +13,10 @@
 #include "jz.h"
 #include "serial.h"
 
-#define BCH_BASE 0xB30D0000
-
 #define BCH_BHCR			(BCH_BASE + 0x0)
 #define BCH_BHCSR			(BCH_BASE + 0x4)
 #define BCH_BHCCR			(BCH_BASE + 0x8)
 #define BCH_BHCNT			(BCH_BASE + 0xc)
-#define BCH_BHDR			(BCH_BASE + 0x10)
 #define BCH_BHPAR0			(BCH_BASE + 0x14)
 #define BCH_BHERR0			(BCH_BASE + 0x28)
 #define BCH_BHINT			(BCH_BASE + 0x24)
@@ -57,7 +54,7 @@
 /* Timeout for BCH calculation/correction. */
 #define BCH_TIMEOUT_US			100000
 
-static void jz4725b_bch_init(void)
+void bch_start_block(void)
 {
 	u32 reg;
 
@@ -86,7 +83,7 @@ static void jz4725b_bch_init(void)
 static void jz4725b_bch_write_data(const uint8_t *buf, unsigned int size)
 {
 	while (size--)
-		REG8(BCH_BHDR) = *buf++;
+		bch_feed(*buf++);
 }
 
 int bch_correct_block(uint8_t *buf, uint8_t *ecc_code)
@@ -95,8 +92,7 @@ int bch_correct_block(uint8_t *buf, uint8_t *ecc_code)
 	unsigned int i;
 	int ret = 0;
 
-	jz4725b_bch_init();
-	jz4725b_bch_write_data(buf, ECC_BLOCK);
+	/* The data was fed while being read; only the parity is left. */
 	jz4725b_bch_write_data(ecc_code, PAR_SIZE);
 
 	do {
@@ -125,7 +121,7 @@ int bch_correct_block(uint8_t *buf, uint8_t *ecc_code)
 		if (i & 1) {
 			bit = (reg & BCH_BHERR_INDEX1_MASK) >> BCH_BHERR_INDEX1_SHIFT;
 		} else {
-			reg = REG32(BCH_BHERR0 + (i * 4));
+			reg = REG32(BCH_BHERR0 + (i / 2) * 4);
 			bit = (reg & BCH_BHERR_INDEX0_MASK) >> BCH_BHERR_INDEX0_SHIFT;
 		}
 
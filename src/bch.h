@@ -10,6 +10,25 @@
 
 #include <stdint.h>
 
+#include "jz.h"
+
+/*
+ * The data of an ECC block goes through the engine while it is read from
+ * the NAND: call bch_start_block(), then bch_feed() each byte as it is
+ * stored to RAM, then bch_correct_block() to check the parity and fix the
+ * block in place.
+ */
+void bch_start_block(void);
 int bch_correct_block(uint8_t *dst, uint8_t *oobbuf);
 
+#if JZ_VERSION == 4740
+/* The RS decoder snoops the NAND data bus by itself. */
+#define bch_feed(val)		do { } while (0)
+#else
+#define BCH_BASE		0xB30D0000
+#define BCH_BHDR		(BCH_BASE + 0x10)
+
+#define bch_feed(val)		(REG8(BCH_BHDR) = (val))
+#endif
+
 #endif /* __UBIBOOT_BCH_H__ */
@@ -0,0 +1,150 @@
+/*
+ * Boot timeline, on the OST of the JZ4760/JZ4770 or a TCU timer of the
+ * older SoCs, both counting EXTAL cycles.
+ */
+
+#include <stdint.h>
+
+#include "bench.h"
+#include "config.h"
+#include "jz.h"
+#include "jz4740-tcu.h"
+#include "utils.h"
+
+#if JZ_VERSION >= 4760
+#define BENCH_PRESCALE	4
+#else
+#include "jz4740-cpm.h"
+
+#define BENCH_TIMER	0
+
+/* The 16-bit counter wraps every 5.5 s at 12 MHz: marks must come closer. */
+#define BENCH_PRESCALE	1024
+
+static uint32_t ticks;
+static uint16_t last_count;
+#endif
+
+/* Outside of the hexadecimal digits, in the order of enum bench_phase */
+static const char phase_ids[BENCH_NB_PHASES] = {
+	'p', 's', 'r', 'm', 'v', 'l', 'k', 'n', 'u',
+};
+
+static uint32_t marks[BENCH_NB_PHASES];
+static uint32_t reached;
+
+#if defined(USE_STAGE2) || defined(STAGE2)
+/* Stage 1 leaves its marks at the start of the kernel area, which is only
+ * loaded once stage 2 took them over. The timer keeps running. */
+#define BENCH_HANDOVER	((struct bench_handover *) (KSEG1 + 0x10000))
+#define BENCH_MAGIC	0x48434e42	/* "BNCH" */
+
+struct bench_handover {
+	uint32_t magic;
+	uint32_t reached;
+	uint32_t marks[BENCH_NB_PHASES];
+#if JZ_VERSION < 4760
+	uint32_t ticks;
+	uint16_t last_count;
+#endif
+};
+#endif
+
+#ifdef USE_STAGE2
+void bench_hand_over(void)
+{
+	struct bench_handover *h = BENCH_HANDOVER;
+
+	memcpy(h->marks, marks, sizeof(marks));
+	h->reached = reached;
+#if JZ_VERSION < 4760
+	h->ticks = ticks;
+	h->last_count = last_count;
+#endif
+	h->magic = BENCH_MAGIC;
+}
+#endif
+
+void bench_start(void)
+{
+#ifdef STAGE2
+	struct bench_handover *h = BENCH_HANDOVER;
+
+	if (h->magic == BENCH_MAGIC) {
+		h->magic = 0;
+		memcpy(marks, h->marks, sizeof(marks));
+		reached = h->reached;
+#if JZ_VERSION < 4760
+		ticks = h->ticks;
+		last_count = h->last_count;
+#endif
+		return;
+	}
+#endif
+
+#if JZ_VERSION >= 4760
+	REG_TCU_TECR = BIT(TCU_OST);
+	REG_TCU_TSCR = BIT(TCU_OST);
+	REG_OST_OSTCSR = OSTCSR_CNT_MD | OSTCSR_SD
+		| TCU_TCSR_EXT_EN | TCU_TCSR_PRESCALE4;
+	REG_OST_OSTCNTL = 0;
+	REG_OST_OSTCNTH = 0;
+	REG_TCU_TESR = BIT(TCU_OST);
+#else
+	__cpm_start_tcu();
+	REG_TCU_TECR = BIT(BENCH_TIMER);
+	REG_TCU_TSCR = BIT(BENCH_TIMER);
+	REG_TCU_TCSR(BENCH_TIMER) = TCU_TCSR_EXT_EN | TCU_TCSR_PRESCALE1024;
+	REG_TCU_TDFR(BENCH_TIMER) = 0xffff;
+	REG_TCU_TCNT(BENCH_TIMER) = 0;
+	REG_TCU_TESR = BIT(BENCH_TIMER);
+#endif
+}
+
+static uint32_t bench_ticks(void)
+{
+#if JZ_VERSION >= 4760
+	return REG_OST_OSTCNTL;
+#else
+	uint16_t count = REG_TCU_TCNT(BENCH_TIMER);
+
+	ticks += (uint16_t)(count - last_count);
+	last_count = count;
+	return ticks;
+#endif
+}
+
+void bench_mark(enum bench_phase phase)
+{
+	marks[phase] = bench_ticks();
+	reached |= BIT(phase);
+}
+
+char *bench_param(void)
+{
+	static char param[sizeof("bootbench=") + BENCH_NB_PHASES * 10];
+	char *ptr = param + sizeof("bootbench=") - 1;
+	unsigned int i, digits;
+
+	memcpy(param, "bootbench=", sizeof("bootbench=") - 1);
+
+	for (i = 0; i < BENCH_NB_PHASES; i++) {
+		uint32_t us;
+
+		if (!(reached & BIT(i)))
+			continue;
+
+		us = marks[i] * BENCH_PRESCALE / (CFG_EXTAL / 1000000);
+		for (digits = 1; digits < 8 && us >> (4 * digits); digits++)
+			;
+
+		*ptr++ = phase_ids[i];
+		ptr += digits;
+		write_hex_digits(us, ptr - 1);
+		*ptr++ = ',';
+	}
+
+	/* Drop the last comma */
+	ptr[-1] = '\0';
+	return param;
+}
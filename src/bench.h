@@ -0,0 +1,42 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/* Boot phases; a mark records the time at which one ended. */
+enum bench_phase {
+	BENCH_PLL_INIT,
+	BENCH_SDRAM_INIT,
+	BENCH_RAM_WORKS,
+	BENCH_MMC_INIT,
+	BENCH_FAT_MOUNT,	/* partition table and FAT boot sector */
+	BENCH_FAT_LOOKUP,	/* kernel file found in the root directory */
+	BENCH_MMC_LOAD,
+	BENCH_UBI_SCAN,		/* kernel volume located */
+	BENCH_UBI_LOAD,
+	BENCH_NB_PHASES,
+};
+
+#ifdef USE_BOOTBENCH
+/* Starts the timer: must run before any mark, once the BSS is cleared. */
+void bench_start(void);
+
+void bench_mark(enum bench_phase phase);
+
+/*
+ * Returns the marks as a kernel parameter: "bootbench=" followed by, for
+ * each phase reached, a letter (see bench.c) and the time in microseconds,
+ * in hexadecimal; e.g. "bootbench=p3a,s1f7,r2c0,m5d21,...".
+ */
+char *bench_param(void);
+
+/*
+ * Stage 1 (USE_STAGE2): leaves the marks for stage 2, whose bench_start()
+ * takes them over instead of restarting the timer.
+ */
+void bench_hand_over(void);
+#else
+#define bench_start() do { } while (0)
+#define bench_mark(phase) do { } while (0)
+#define bench_hand_over() do { } while (0)
+#endif
+
+#endif /* BENCH_H */
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdint.h>
 
+#include "bench.h"
 #include "board.h"
 #include "config.h"
 #include "sdram.h"
@@ -310,7 +311,9 @@ static void sdram_init(void)
 void board_init(void)
 {
 	pll_init();
+	bench_mark(BENCH_PLL_INIT);
 	sdram_init();
+	bench_mark(BENCH_SDRAM_INIT);
 
 #ifdef USE_SERIAL
 	/* UART2 pins */
@@ -11,6 +11,7 @@
 
 #include "config.h"
 
+#include "bench.h"
 #include "board.h"
 #include "serial.h"
 #include "utils.h"
@@ -457,9 +458,11 @@ void board_init(void)
 #endif
 
 	pll_init();
+	bench_mark(BENCH_PLL_INIT);
 	SERIAL_PUTS_ARGI("PLL running at ", __cpm_get_pllout() / 1000000, " MHz.\n");
 
 	sdram_init();
+	bench_mark(BENCH_SDRAM_INIT);
 	SERIAL_PUTS_ARGI("SDRAM running at ", __cpm_get_mclk() / 1000000, " MHz.\n");
 	SERIAL_PUTS_ARGI("SDRAM size is ", get_memory_size() / 1048576, " MiB.\n");
 
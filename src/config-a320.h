@@ -24,12 +24,18 @@
 #define ECC_BLOCK	512
 #define ECC_POS		6
 #define PAR_SIZE	9
+/* #define NAND_CACHE_READ */ /* chip supports READ CACHE SEQUENTIAL */
+#define NAND_TCCS	100 /* ns, from RNDOUTSTART to data out */
 
 /* UBI parameters */
 #define UBI_MTD_EB_START	5
 #define UBI_MTD_NB_EB		127
 #define UBI_KERNEL_VOLUME	"kernel"
 #define UBI_KERNEL_BAK_VOLUME	"kernel_bak"
+#define UBI_INITRD_VOLUME	"initrd"
+#define UBI_INITRD_BAK_VOLUME	"initrd_bak"
+#define UBI_FDT_VOLUME		"devicetree"
+#define UBI_FDT_BAK_VOLUME	"devicetree_bak"
 #define UBI_ROOTFS_MTDNAME	"rootfs"
 #define UBI_ROOTFS_VOLUME	"rootfs"
 
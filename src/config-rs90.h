@@ -23,8 +23,12 @@
 #define ROW_CYCLE 3 /* 3 or 2 */
 #define ECC_BLOCK	512
 #define PAGE_PER_BLOCK	64
+#define BAD_BLOCK_POS	0
+#define BAD_BLOCK_PAGE	0
 #define ECC_POS		3
 #define PAR_SIZE	13
+/* #define NAND_CACHE_READ */ /* chip supports READ CACHE SEQUENTIAL */
+#define NAND_TCCS	100 /* ns, from RNDOUTSTART to data out */
 
 #define EMC_TAS		2
 #define EMC_TAH		1
@@ -37,5 +41,9 @@
 #define UBI_MTD_NB_EB		2045
 #define UBI_KERNEL_VOLUME	"kernel"
 #define UBI_KERNEL_BAK_VOLUME	"kernel_bak"
+#define UBI_INITRD_VOLUME	"initrd"
+#define UBI_INITRD_BAK_VOLUME	"initrd_bak"
+#define UBI_FDT_VOLUME		"devicetree"
+#define UBI_FDT_BAK_VOLUME	"devicetree_bak"
 #define UBI_ROOTFS_MTDNAME	"system"
 #define UBI_ROOTFS_VOLUME	"rootfs"
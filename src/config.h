@@ -11,10 +11,25 @@
 /*                        		12345678123 */
 #define FAT_BOOTIMAGE_ALT_NAME	"UZIMAGE BAK"
 /*                            	12345678123 */
+#define FAT_FITIMAGE_NAME		"BOOT    ITB"
+/*                       		12345678123 */
+#define FAT_FITIMAGE_ALT_NAME	"BOOTBAK ITB"
+/*                           	12345678123 */
 
 /* Physical address to load kernel image at */
 #define LD_ADDR					0x00600000
 
+/* Where stage 1 finds stage 2 (USE_STAGE2): a range of raw SD sectors,
+ * between stage 1 and the first partition, followed by the backup copy; or
+ * a UBI volume. */
+#define STAGE2_MMC_SECTOR		64
+#define STAGE2_MMC_NB_SECTORS	960
+#define UBI_STAGE2_VOLUME		"stage2"
+#define UBI_STAGE2_BAK_VOLUME	"stage2_bak"
+
+/* MBR partition type of the hibernation snapshot (USE_RESUME) */
+#define RESUME_PART_TYPE		0xda
+
 /* Board-specific config */
 #if defined(BOARD_gcw0)
 #include "config-gcw0.h"
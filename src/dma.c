@@ -0,0 +1,56 @@
+/*
+ * DMA controller of the JZ4740: just enough of it to move blocks of
+ * data from the NAND data port to memory.
+ */
+
+#include "dma.h"
+#include "jz.h"
+#include "jz4740-cpm.h"
+#include "jz4740-dmac.h"
+
+#define DMA_CHANNEL	0
+
+void dma_init(void)
+{
+	__cpm_start_dmac();
+
+	REG_DMAC_DCCSR(DMA_CHANNEL) = 0;
+	REG_DMAC_DMACR = DMAC_DMACR_DMAE;
+}
+
+void dma_start_read(void *dst, uint32_t port, size_t len,
+		    unsigned int port_width)
+{
+	uint32_t cmd = DMAC_DCMD_DAI | DMAC_DCMD_DWDH_32 | DMAC_DCMD_DS_32BIT;
+
+	if (port_width == 8)
+		cmd |= DMAC_DCMD_SWDH_8;
+	else if (port_width == 16)
+		cmd |= DMAC_DCMD_SWDH_16;
+
+	REG_DMAC_DCCSR(DMA_CHANNEL) = 0;
+	REG_DMAC_DSAR(DMA_CHANNEL) = PHYSADDR(port);
+	REG_DMAC_DTAR(DMA_CHANNEL) = PHYSADDR(dst);
+	REG_DMAC_DTCR(DMA_CHANNEL) = len / 4;
+	REG_DMAC_DRSR(DMA_CHANNEL) = DMAC_DRSR_RS_AUTO;
+	REG_DMAC_DCMD(DMA_CHANNEL) = cmd;
+	REG_DMAC_DCCSR(DMA_CHANNEL) = DMAC_DCCSR_NDES | DMAC_DCCSR_EN;
+}
+
+int dma_wait(void)
+{
+	uint32_t stat;
+
+	do {
+		stat = REG_DMAC_DCCSR(DMA_CHANNEL);
+	} while (!(stat & (DMAC_DCCSR_TT | DMAC_DCCSR_AR | DMAC_DCCSR_HLT)));
+
+	REG_DMAC_DCCSR(DMA_CHANNEL) = 0;
+
+	if (stat & (DMAC_DCCSR_AR | DMAC_DCCSR_HLT)) {
+		REG_DMAC_DMACR = DMAC_DMACR_DMAE;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef DMA_H
+#define DMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Single-channel DMA copies from a fixed-address device port to memory.
+ * The destination must be a word aligned buffer that the data cache doesn't
+ * hold: uncached (KSEG1), or just flushed from the cache; its size a
+ * multiple of 4 bytes.
+ */
+
+void dma_init(void);
+
+/* 'port_width' is the width in bits of the device port: 8, 16 or 32. */
+void dma_start_read(void *dst, uint32_t port, size_t len,
+		    unsigned int port_width);
+
+/* Waits for the transfer to end; returns non-zero on an address error. */
+int dma_wait(void);
+
+#endif
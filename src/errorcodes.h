@@ -10,7 +10,7 @@
 #define ERR_FAT_IO_ROOT		0x06		/* Unable to read root directory. */
 #define ERR_FAT_NO_KERNEL	0x07		/* Kernel file not found. */
 #define ERR_FAT_IO_BOOT		0x08		/* Unable to read bootsector. */
-#define ERR_FAT_BAD_IMAGE	0x09		/* uImage header rejected. */
+#define ERR_FAT_BAD_IMAGE	0x09		/* Kernel image header rejected. */
 
 #define ERR_MMC_INIT		0x10		/* Initialization failed. */
 #define ERR_MMC_TIMEOUT		0x11		/* Time out. */
@@ -18,9 +18,25 @@
 
 #define ERR_NAND_IO_UNC		0x20		/* Uncorrectable read error. */
 #define ERR_NAND_IO			0x21		/* Read error. */
+#define ERR_NAND_DMA		0x22		/* DMA transfer failed. */
+#define ERR_NAND_ONFI		0x23		/* ONFI or JEDEC parameter page corrupted. */
+#define ERR_NAND_GEOMETRY	0x24		/* NAND geometry differs from the config. */
 
 #define ERR_UBI_NO_PART		0x30		/* Partition is not a UBI drive. */
 #define ERR_UBI_NO_KERNEL	0x31		/* Unable to locate kernel partition. */
 #define ERR_UBI_IO		0x32		/* UBI structure parsing failed */
+#define ERR_UBI_BAD_CRC		0x33		/* Volume data corrupted. */
+
+#define ERR_FIT_BAD_IMAGE	0x40		/* FIT image or component rejected. */
+#define ERR_FIT_NO_CONF		0x41		/* No usable FIT configuration. */
+#define ERR_FIT_BAD_HASH	0x42		/* FIT component hash mismatch. */
+#define ERR_FIT_BOOTARGS	0x43		/* Unable to pass the command line. */
+
+#define ERR_STAGE2_IO		0x50		/* Unable to read stage 2. */
+#define ERR_STAGE2_BAD_IMAGE	0x51		/* Stage 2 image rejected. */
+#define ERR_STAGE2_OVERLAP	0x52		/* Image would overwrite stage 2. */
+
+#define ERR_RESUME_IO		0x60		/* Unable to read the snapshot. */
+#define ERR_RESUME_BAD_IMAGE	0x61		/* Snapshot data corrupted. */
 
 #endif
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "bench.h"
 #include "config.h"
 #include "jz.h"
 #include "serial.h"
@@ -9,6 +10,7 @@
 #include "fat.h"
 #include "errorcodes.h"
 #include "uimage.h"
+#include "warmboot.h"
 #include "utils.h"
 
 uint32_t lba_fat1;			/* sector of first FAT */
@@ -18,7 +20,8 @@ uint8_t cluster_size;		/* sectors per cluster */
 
 static int get_first_partition(unsigned int id, uint32_t *lba)
 {
-#ifdef MBR_PRELOAD_ADDR
+	/* Stage 2 can't count on the copy the boot ROM left in the cache. */
+#if defined(MBR_PRELOAD_ADDR) && !defined(STAGE2)
 	struct mbr *mbr = (struct mbr *) MBR_PRELOAD_ADDR;
 #else
 	uint8_t mbr_data[MMC_SECTOR_SIZE];
@@ -71,6 +74,14 @@ static int process_boot_sector(unsigned int id, uint32_t lba)
 	return 0;
 }
 
+#ifdef USE_CACHE_RAM
+#define FAT_WINDOW	8	/* FAT sectors read at once */
+
+static uint32_t fat_window[FAT_WINDOW * (FAT_BLOCK_SIZE >> 2)] __cache_ram;
+#else
+#define FAT_WINDOW	1
+#endif
+
 /*
  * Given a cluster, follow the cluster chain while the cluster numbers are
  * consecutive. Outputs the next cluster number and the number of clusters
@@ -81,16 +92,20 @@ static int process_boot_sector(unsigned int id, uint32_t lba)
 static int cluster_span(
 		unsigned int id, uint32_t cluster, uint32_t *next, uint32_t *count)
 {
+#ifdef USE_CACHE_RAM
+	uint32_t *sector = fat_window;
+#else
 	uint32_t sector[FAT_BLOCK_SIZE >> 2];
-	uint32_t cached_fat_sector = -1;
+#endif
+	uint32_t cached_fat_sector = -FAT_WINDOW;
 	uint32_t start_cluster = cluster;
 
 	while (1) {
 		uint32_t fat_sector = lba_fat1 + cluster / (FAT_BLOCK_SIZE >> 2);
 
 		/* Read FAT */
-		if (fat_sector != cached_fat_sector) {
-			if (mmc_block_read(id, sector, fat_sector, 1)) {
+		if (fat_sector - cached_fat_sector >= FAT_WINDOW) {
+			if (mmc_block_read(id, sector, fat_sector, FAT_WINDOW)) {
 				SERIAL_ERR(ERR_FAT_IO_FAT);
 				return -1;
 			}
@@ -98,7 +113,9 @@ static int cluster_span(
 		}
 
 		uint32_t prev_cluster = cluster;
-		cluster = sector[cluster % (FAT_BLOCK_SIZE >> 2)] & 0x0fffffff;
+		cluster = sector[(fat_sector - cached_fat_sector)
+				 * (FAT_BLOCK_SIZE >> 2)
+				 + cluster % (FAT_BLOCK_SIZE >> 2)] & 0x0fffffff;
 		if (cluster != prev_cluster + 1) {
 			*next = cluster;
 			*count = prev_cluster + 1 - start_cluster;
@@ -109,14 +126,17 @@ static int cluster_span(
 
 /*
  * Loads data from the cluster chain starting at the given cluster number.
- * When 'exec_addr' is not NULL, it indicates that an uImage is being loaded
- * and the execution address (entry point) should be extracted from the
- * uImage header and written via that pointer. Also the image body should
- * be loaded to the load address from the uImage header instead of 'ld_addr'.
+ * When 'exec_addr' is not NULL, it indicates that a kernel image is being
+ * loaded and the execution address (entry point) should be extracted from the
+ * image header and written via that pointer. Also the image is received
+ * directly at the load address(es) found in its header instead of 'ld_addr',
+ * which is then left untouched. 'fit' tells a FIT image from a kernel.
  */
 static void *load_cluster_chain(unsigned int id, uint32_t cluster,
-		void *ld_addr, void **exec_addr)
+		void *ld_addr, void **exec_addr, int fit)
 {
+	uint32_t scratch[MMC_SECTOR_SIZE >> 2];
+	uint32_t offset = 0;
 	int err = ERR_FAT_BAD_IMAGE;
 
 	while (cluster > 1 && cluster < 0x0ffffff0) {
@@ -129,25 +149,56 @@ static void *load_cluster_chain(unsigned int id, uint32_t cluster,
 		/* Start read command. */
 		data_sector = lba_data + (cluster - 2) * cluster_size;
 		num_data_sectors = num_clusters * cluster_size;
+
+		/* Files loaded as they are may be any size. */
+		if (!exec_addr && overlaps_loader(ld_addr,
+				num_data_sectors * MMC_SECTOR_SIZE))
+			return NULL;
+
 		mmc_start_block(id, data_sector, num_data_sectors);
 
 		/* Receive data. */
 		err = 0;
 		while (num_data_sectors--) {
-			if (mmc_receive_block(id, ld_addr)) {
+			void *dst = ld_addr;
+
+			/* Kernel image sectors are received in place, unless
+			 * they straddle segment boundaries. The header goes to
+			 * the scratch buffer too, since the load address is not
+			 * known before it is parsed. */
+			if (exec_addr) {
+				dst = offset ? image_block_addr(
+						offset, MMC_SECTOR_SIZE) : NULL;
+				if (!dst)
+					dst = scratch;
+			}
+
+			if (mmc_receive_block(id, dst)) {
 				err = ERR_FAT_IO_PART;
 				break;
 			}
-			if (exec_addr) {
-				ld_addr = process_uimage_header(ld_addr, exec_addr, MMC_SECTOR_SIZE);
-				if (!ld_addr) {
+
+			if (!exec_addr) {
+				ld_addr += MMC_SECTOR_SIZE;
+				continue;
+			}
+
+			if (!offset) {
+				if (fit)
+					err = process_fit_header(scratch,
+							exec_addr, MMC_SECTOR_SIZE);
+				else
+					err = process_image_header(scratch,
+							exec_addr, MMC_SECTOR_SIZE);
+				if (err) {
 					err = ERR_FAT_BAD_IMAGE;
 					break;
 				}
-				exec_addr = NULL;
-			} else {
-				ld_addr += MMC_SECTOR_SIZE;
+			} else if (dst == scratch || fit) {
+				image_scatter(offset, dst, MMC_SECTOR_SIZE);
 			}
+
+			offset += MMC_SECTOR_SIZE;
 		}
 
 		mmc_stop_block(id);
@@ -158,6 +209,9 @@ static void *load_cluster_chain(unsigned int id, uint32_t cluster,
 		cluster = next_cluster;
 	}
 
+	if (!err && exec_addr && image_finish(offset))
+		err = ERR_FAT_BAD_IMAGE;
+
 	if (err) {
 		SERIAL_ERR(err);
 		return NULL;
@@ -188,16 +242,59 @@ static struct dir_entry *find_file(
 	return NULL;
 }
 
-static const char *kernel_names[] = {
-	FAT_BOOTIMAGE_NAME,
-	FAT_BOOTFILE_NAME,
-	FAT_BOOTIMAGE_ALT_NAME,
-	FAT_BOOTFILE_ALT_NAME,
+enum kernel_type {
+#ifdef USE_FIT
+	KERNEL_FIT,
+#endif
+	KERNEL_UIMAGE,
+	KERNEL_RAW,
+	NB_KERNEL_TYPES,
+};
+
+#ifdef USE_FIT
+#define is_fit(type) ((type) == KERNEL_FIT)
+#else
+#define is_fit(type) 0
+#endif
+
+static const char *kernel_names[2][NB_KERNEL_TYPES] = {
+	{
+#ifdef USE_FIT
+		[KERNEL_FIT] = FAT_FITIMAGE_NAME,
+#endif
+		[KERNEL_UIMAGE] = FAT_BOOTIMAGE_NAME,
+		[KERNEL_RAW] = FAT_BOOTFILE_NAME,
+	},
+	{
+#ifdef USE_FIT
+		[KERNEL_FIT] = FAT_FITIMAGE_ALT_NAME,
+#endif
+		[KERNEL_UIMAGE] = FAT_BOOTIMAGE_ALT_NAME,
+		[KERNEL_RAW] = FAT_BOOTFILE_ALT_NAME,
+	},
 };
 
+#if defined(USE_RESUME) || defined(USE_WARMBOOT)
+/*
+ * The first sector of a vmlinuz.bin is start-up code that is the same in
+ * every build: the directory entry tells the files apart.
+ */
+static uint32_t kernel_file_crc(const struct dir_entry *entry,
+				const void *first_sector)
+{
+	uint32_t crc = crc32(0xffffffff, first_sector, MMC_SECTOR_SIZE);
+
+	return crc32(crc, &entry->starthi,
+		     sizeof(*entry) - offsetof(struct dir_entry, starthi));
+}
+#endif
+
 int mmc_load_kernel(unsigned int id, void *ld_addr, int alt, void **exec_addr)
 {
 	struct dir_entry *dir_start, *dir_end;
+#ifdef USE_WARMBOOT
+	struct dir_entry file;
+#endif
 	uint32_t lba;
 	int err, i;
 
@@ -209,34 +306,55 @@ int mmc_load_kernel(unsigned int id, void *ld_addr, int alt, void **exec_addr)
 	if (err)
 		return err;
 
+	bench_mark(BENCH_FAT_MOUNT);
+
 	dir_start = NULL;
 	err = 0;
-	for (i = 0; i < 4; i++) {
-		const int kernel = i ^ (alt ? 2 : 0);
+	for (i = 0; i < 2 * NB_KERNEL_TYPES; i++) {
+		const int bak = (i / NB_KERNEL_TYPES) ^ !!alt;
+		const enum kernel_type type = i % NB_KERNEL_TYPES;
+		const char *name = kernel_names[bak][type];
 		struct dir_entry *entry;
+		uint32_t cluster;
+		void *end;
 
 		if (!dir_start) {
 			/* Load root directory. */
 			dir_start = ld_addr;
-			dir_end = load_cluster_chain(id, root_cluster, dir_start, NULL);
+			dir_end = load_cluster_chain(id, root_cluster, dir_start,
+						     NULL, 0);
 			if (!dir_end)
 				return -1;
 		}
 
-		entry = find_file(dir_start, dir_end, kernel_names[kernel]);
+		entry = find_file(dir_start, dir_end, name);
 
 		if (entry) {
+			bench_mark(BENCH_FAT_LOOKUP);
 			dir_start = NULL;
-			*exec_addr = ld_addr;
+			cluster = entry->starthi << 16 | entry->start;
+#ifdef USE_WARMBOOT
+			/* The directory is about to be overwritten. */
+			file = *entry;
+#endif
 
 			SERIAL_PUTS("MMC: Loading kernel file ");
-			SERIAL_PUTS(kernel_names[kernel]);
+			SERIAL_PUTS(name);
 			SERIAL_PUTC('\n');
 
-			if (load_cluster_chain(
-						id, entry->starthi << 16 | entry->start,
-						ld_addr, (kernel & 1) ? NULL : exec_addr))
-				return kernel >> 1;
+			*exec_addr = ld_addr;
+
+			end = load_cluster_chain(id, cluster, ld_addr,
+					type == KERNEL_RAW ? NULL : exec_addr,
+					is_fit(type));
+			if (end) {
+				if (type == KERNEL_RAW) {
+					set_boot_kernel(ld_addr, end - ld_addr);
+					warm_keep_image(end - ld_addr,
+						kernel_file_crc(&file, ld_addr));
+				}
+				return bak;
+			}
 			err = -1;
 		}
 	}
@@ -248,3 +366,34 @@ int mmc_load_kernel(unsigned int id, void *ld_addr, int alt, void **exec_addr)
 		return -1;
 	}
 }
+
+#if defined(USE_RESUME) || defined(USE_WARMBOOT)
+int mmc_kernel_crc(unsigned int id, void *buf, uint32_t *crc)
+{
+	uint32_t sector[MMC_SECTOR_SIZE >> 2];
+	struct dir_entry *entry = NULL;
+	uint32_t lba, cluster;
+	void *dir_end;
+	int i;
+
+	if (get_first_partition(id, &lba) || process_boot_sector(id, lba))
+		return -1;
+
+	dir_end = load_cluster_chain(id, root_cluster, buf, NULL, 0);
+	if (!dir_end)
+		return -1;
+
+	for (i = 0; i < NB_KERNEL_TYPES && !entry; i++)
+		entry = find_file(buf, dir_end, kernel_names[0][i]);
+	if (!entry)
+		return -1;
+
+	cluster = entry->starthi << 16 | entry->start;
+	if (mmc_block_read(id, sector,
+			   lba_data + (cluster - 2) * cluster_size, 1))
+		return -1;
+
+	*crc = kernel_file_crc(entry, sector);
+	return 0;
+}
+#endif
@@ -85,6 +85,8 @@ struct dir_entry {
 /*
  * Attempts to load a kernel from the MMC/SD card in slot 'id' into memory
  * at 'ld_addr'. If 'alt' is true, try the alternative name first.
+ * When built with FIT support, a FIT image is looked for before the
+ * other kernel files.
  * The execution address of the loaded kernel is written to the output argument
  * 'exec_addr'; nothing is written if the load was unsuccessful.
  * Return 0 if a regular kernel was loaded, 1 if an alternative kernel
@@ -92,4 +94,14 @@ struct dir_entry {
  */
 int mmc_load_kernel(unsigned int id, void *ld_addr, int alt, void **exec_addr);
 
+/*
+ * Computes a CRC32 that identifies the kernel file that would be loaded when
+ * 'alt' is false, cheaply: it covers the first sector, whose image headers
+ * carry a data CRC or a timestamp, and the size, modification date and time
+ * and start cluster from the directory entry, which tell raw kernels apart.
+ * The root directory is loaded at 'buf'. Returns 0 on success, -1 if no
+ * kernel file could be read.
+ */
+int mmc_kernel_crc(unsigned int id, void *buf, uint32_t *crc);
+
 #endif
@@ -0,0 +1,183 @@
+/*
+ * Flattened device tree: just enough of it to walk FIT images and hand
+ * the kernel command line over through /chosen/bootargs.
+ *
+ * https://www.devicetree.org/specifications/
+ */
+
+#include "fdt.h"
+#include "utils.h"
+
+#define fdt32(val) __bswap32(val)
+
+static const uint32_t *fdt_next(const uint32_t *tag)
+{
+	switch (fdt32(*tag++)) {
+	case FDT_BEGIN_NODE:
+		/* Skip the name, NUL-terminated and padded to 4 bytes. */
+		return tag + strlen((const char *) tag) / 4 + 1;
+	case FDT_PROP:
+		return tag + 2 + (fdt32(tag[0]) + 3) / 4;
+	default:
+		return tag;
+	}
+}
+
+const uint32_t *fdt_root(const void *fdt)
+{
+	const struct fdt_header *hdr = fdt;
+
+	if (fdt32(hdr->magic) != FDT_MAGIC)
+		return NULL;
+
+	return fdt + fdt32(hdr->off_dt_struct);
+}
+
+const uint32_t *fdt_subnode(const uint32_t *node, const char *name)
+{
+	const uint32_t *tag;
+	unsigned int depth = 0;
+	size_t len = strlen(name) + 1;
+
+	for (tag = fdt_next(node); ; tag = fdt_next(tag)) {
+		switch (fdt32(*tag)) {
+		case FDT_BEGIN_NODE:
+			if (!depth++ && !strncmp((const char *) (tag + 1), name, len))
+				return tag;
+			break;
+		case FDT_END_NODE:
+			if (!depth--)
+				return NULL;
+			break;
+		case FDT_END:
+			return NULL;
+		}
+	}
+}
+
+static const uint32_t *fdt_find_prop(const void *fdt, const uint32_t *node,
+				     const char *name)
+{
+	const struct fdt_header *hdr = fdt;
+	const char *strings = fdt + fdt32(hdr->off_dt_strings);
+	const uint32_t *tag = fdt_next(node);
+	size_t len = strlen(name) + 1;
+
+	/* Properties always come before the subnodes. */
+	for (; ; tag = fdt_next(tag)) {
+		uint32_t token = fdt32(*tag);
+
+		if (token == FDT_PROP) {
+			if (!strncmp(strings + fdt32(tag[2]), name, len))
+				return tag;
+		} else if (token != FDT_NOP) {
+			return NULL;
+		}
+	}
+}
+
+const void *fdt_getprop(const void *fdt, const uint32_t *node,
+			const char *name, uint32_t *len)
+{
+	const uint32_t *tag = fdt_find_prop(fdt, node, name);
+
+	if (!tag)
+		return NULL;
+
+	*len = fdt32(tag[1]);
+	return tag + 3;
+}
+
+uint32_t fdt_getprop_u32(const void *fdt, const uint32_t *node,
+			 const char *name, uint32_t def)
+{
+	uint32_t len;
+	const uint32_t *val = fdt_getprop(fdt, node, name, &len);
+
+	return val && len == 4 ? fdt32(*val) : def;
+}
+
+int fdt_set_bootargs(void *fdt, char * const *params, unsigned int nb)
+{
+	static const char prop_name[] = "bootargs";
+	struct fdt_header *hdr = fdt;
+	const uint32_t *root = fdt_root(fdt);
+	uint32_t *tag, *chosen;
+	uint32_t totalsize, strings_size, len, size, nameoff, removed = 0;
+	char *strings, *str;
+	unsigned int i;
+
+	if (!root)
+		return -1;
+
+	chosen = (uint32_t *) fdt_subnode(root, "chosen");
+	if (!chosen)
+		return -1;
+
+	totalsize = fdt32(hdr->totalsize);
+	strings_size = fdt32(hdr->size_dt_strings);
+	if (fdt32(hdr->off_dt_strings) + strings_size != totalsize)
+		return -1;
+
+	/* Drop the command line the DTB came with, if any: removing it rather
+	 * than blanking it out keeps the blob from growing when the command
+	 * line is set again, after a warm reboot. */
+	tag = (uint32_t *) fdt_find_prop(fdt, chosen, prop_name);
+	if (tag) {
+		const void *end = fdt_next(tag);
+
+		removed = end - (void *) tag;
+		memmove(tag, end, fdt + totalsize - end);
+		totalsize -= removed;
+	}
+
+	/* Reuse the property name if another node already has it. */
+	strings = fdt + fdt32(hdr->off_dt_strings) - removed;
+	for (nameoff = 0; nameoff < strings_size;
+			nameoff += strlen(strings + nameoff) + 1) {
+		if (!strncmp(strings + nameoff, prop_name, sizeof(prop_name)))
+			break;
+	}
+
+	for (len = 0, i = 0; i < nb; i++) {
+		if (params[i][0])
+			len += strlen(params[i]) + 1;
+	}
+
+	/* Make room for the new property at the start of /chosen. */
+	size = 3 * 4 + ((len + 3) & ~3);
+	tag = (uint32_t *) fdt_next(chosen);
+	memmove((void *) tag + size, tag, fdt + totalsize - (void *) tag);
+	strings += size;
+	totalsize += size;
+
+	if (nameoff == strings_size) {
+		memcpy(strings + strings_size, prop_name, sizeof(prop_name));
+		strings_size += sizeof(prop_name);
+		totalsize += sizeof(prop_name);
+	}
+
+	tag[size / 4 - 1] = 0; /* padding */
+	tag[0] = fdt32(FDT_PROP);
+	tag[1] = fdt32(len);
+	tag[2] = fdt32(nameoff);
+
+	str = (char *) &tag[3];
+	for (i = 0; i < nb; i++) {
+		if (params[i][0]) {
+			size_t param_len = strlen(params[i]);
+
+			memcpy(str, params[i], param_len);
+			str += param_len;
+			*str++ = ' ';
+		}
+	}
+	if (len)
+		str[-1] = '\0';
+
+	hdr->totalsize = fdt32(totalsize);
+	hdr->off_dt_strings = fdt32(fdt32(hdr->off_dt_strings) + size - removed);
+	hdr->size_dt_strings = fdt32(strings_size);
+	hdr->size_dt_struct = fdt32(fdt32(hdr->size_dt_struct) + size - removed);
+	return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef FDT_H
+#define FDT_H
+
+#include <stdint.h>
+
+#define FDT_MAGIC	0xd00dfeed
+
+/* Room for the kernel command line, which is added to the device tree */
+#define FDT_BOOTARGS_ROOM	0x1000
+
+/* Structure block tokens */
+#define FDT_BEGIN_NODE	1
+#define FDT_END_NODE	2
+#define FDT_PROP	3
+#define FDT_NOP		4
+#define FDT_END		9
+
+struct fdt_header {
+	/* Note: All fields are big endian. */
+	uint32_t	magic;				/* Magic number (FDT_MAGIC) */
+	uint32_t	totalsize;			/* Total size of the blob */
+	uint32_t	off_dt_struct;		/* Offset of the structure block */
+	uint32_t	off_dt_strings;		/* Offset of the strings block */
+	uint32_t	off_mem_rsvmap;		/* Offset of the memory reserve map */
+	uint32_t	version;			/* Format version */
+	uint32_t	last_comp_version;	/* Last compatible version */
+	uint32_t	boot_cpuid_phys;	/* Physical ID of the boot CPU */
+	uint32_t	size_dt_strings;	/* Size of the strings block */
+	uint32_t	size_dt_struct;		/* Size of the structure block */
+};
+
+/*
+ * Nodes are designated by a pointer to their FDT_BEGIN_NODE token.
+ * Returns the root node, or NULL if 'fdt' does not point to a device tree.
+ */
+const uint32_t *fdt_root(const void *fdt);
+
+/* Returns the direct child of 'node' called 'name', or NULL. */
+const uint32_t *fdt_subnode(const uint32_t *node, const char *name);
+
+/*
+ * Returns a pointer to the value of the property 'name' of 'node' and writes
+ * its length to 'len', or returns NULL if the node has no such property.
+ */
+const void *fdt_getprop(const void *fdt, const uint32_t *node,
+			const char *name, uint32_t *len);
+
+/* Reads a property holding a single big endian cell; returns 'def' if absent. */
+uint32_t fdt_getprop_u32(const void *fdt, const uint32_t *node,
+			 const char *name, uint32_t def);
+
+/*
+ * Sets the /chosen/bootargs property to the given parameters, separated by
+ * spaces; empty parameters are skipped. The blob grows in place, so there must
+ * be some room after it. Only the layout produced by dtc (strings block at the
+ * end) is supported. Returns 0 on success.
+ */
+int fdt_set_bootargs(void *fdt, char * const *params, unsigned int nb);
+
+#endif
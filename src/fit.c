@@ -0,0 +1,266 @@
+/*
+ * FIT: U-Boot flattened image tree
+ *
+ * Supports an uncompressed kernel plus an optional device tree and
+ * initramfs. Data stored after the tree (mkimage -E) is received straight at
+ * its final address, its CRC32 being computed on the way. Data embedded in
+ * the tree can only be located once the whole tree is in, and is moved out
+ * of it then. Only CRC32 hashes are checked; an image whose hashes all use
+ * other algorithms is rejected.
+ */
+
+#include "config.h"
+#include "board.h"
+#include "errorcodes.h"
+#include "fdt.h"
+#include "fit.h"
+#include "jz.h"
+#include "serial.h"
+#include "uimage.h"
+#include "utils.h"
+
+struct fit_image {
+	const uint32_t *node;
+	const void *data;	/* embedded data, or NULL */
+	uint32_t offset;	/* of the external data in the file */
+	uint32_t size;
+	int check_crc;
+	uint32_t crc;
+	void *dst;
+};
+
+static const char *hash_names[] = {
+	"hash-1",
+	"hash@1",
+	"hash-2",
+	"hash@2",
+};
+
+static int fit_get_crc(const void *fit, struct fit_image *img)
+{
+	const uint32_t *hash, *value;
+	const char *algo;
+	unsigned int i;
+	uint32_t len;
+	int err = 0;
+
+	img->check_crc = 0;
+
+	for (i = 0; i < ARRAY_SIZE(hash_names); i++) {
+		hash = fdt_subnode(img->node, hash_names[i]);
+		if (!hash)
+			continue;
+
+		algo = fdt_getprop(fit, hash, "algo", &len);
+		value = fdt_getprop(fit, hash, "value", &len);
+		if (algo && value && len == 4 && !strncmp(algo, "crc32", 6)) {
+			img->check_crc = 1;
+			img->crc = __bswap32(*value);
+			return 0;
+		}
+
+		/* Hashed, but not in a way we can check */
+		err = -1;
+	}
+
+	return err;
+}
+
+/*
+ * Looks up the image referred to by the property 'type' of the configuration.
+ * Returns 1 if the configuration has no such image, a negative number if
+ * the image is invalid.
+ */
+static int fit_get_image(const void *fit, const uint32_t *images,
+			 const uint32_t *conf, const char *type,
+			 struct fit_image *img)
+{
+	const struct fdt_header *hdr = fit;
+	uint32_t len, tree_size = __bswap32(hdr->totalsize);
+	const char *name;
+
+	img->node = NULL;
+
+	name = fdt_getprop(fit, conf, type, &len);
+	if (!name)
+		return 1;
+
+	img->node = fdt_subnode(images, name);
+	if (!img->node)
+		return -1;
+
+	img->data = fdt_getprop(fit, img->node, "data", &img->size);
+	if (!img->data) {
+		/* External data: offsets are relative to the end of the tree,
+		 * unless given as an absolute position. */
+		img->offset = fdt_getprop_u32(fit, img->node,
+					      "data-position", 0);
+		if (!img->offset) {
+			img->offset = (tree_size + 3) & ~3;
+			img->offset += fdt_getprop_u32(fit, img->node,
+						       "data-offset", 0);
+		}
+
+		img->size = fdt_getprop_u32(fit, img->node, "data-size", 0);
+
+		/* What precedes the end of the tree was received already. */
+		if (img->offset < tree_size)
+			return -1;
+	}
+
+	if (fit_get_crc(fit, img)) {
+		SERIAL_ERR(ERR_FIT_BAD_HASH);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int overlaps(const void *a, uint32_t a_size,
+		    const void *b, uint32_t b_size)
+{
+	return a < b + b_size && b < a + a_size;
+}
+
+/*
+ * Picks the address of an image: its load address, or right below '*top',
+ * which is then lowered. 'room' bytes after it are reserved too. Returns -1
+ * if the image would not fit in low memory, or would overwrite the tree or
+ * the kernel.
+ */
+static int fit_place(const void *fit, struct fit_image *img, uint32_t room,
+		     void **top, void *lowmem_top,
+		     const struct fit_image *kernel)
+{
+	const struct fdt_header *hdr = fit;
+	uint32_t load = fdt_getprop_u32(fit, img->node, "load", 0);
+	uint32_t size = img->size + room;
+
+	if (load) {
+		img->dst = (void *) LOADADDR(load);
+	} else {
+		if (size > (uint32_t) (*top - (void *) LOAD_SEG))
+			return -1;
+
+		img->dst = (void *) (((uint32_t) *top - size) & ~0xfff);
+		*top = img->dst;
+	}
+
+	if (img->dst < (void *) LOAD_SEG || img->dst > lowmem_top
+	    || size > (uint32_t) (lowmem_top - img->dst)
+	    || overlaps(img->dst, size, fit, __bswap32(hdr->totalsize))
+	    || overlaps(img->dst, size, kernel->dst, kernel->size))
+		return -1;
+
+	return 0;
+}
+
+/* Moves embedded data out of the tree; has external data streamed in. */
+static int fit_load_image(const struct fit_image *img)
+{
+	if (!img->data)
+		return image_add_segment(img->offset, img->size, img->dst,
+					 img->check_crc, img->crc);
+
+	if (overlaps_loader(img->dst, img->size))
+		return -1;
+
+	if (img->check_crc && ~crc32(~0, img->data, img->size) != img->crc) {
+		SERIAL_ERR(ERR_FIT_BAD_HASH);
+		return -1;
+	}
+
+	memmove(img->dst, img->data, img->size);
+	return 0;
+}
+
+int fit_process_tree(const void *fit, void **exec_addr)
+{
+	const uint32_t *root, *images, *confs, *conf;
+	struct fit_image kernel, fdt, ramdisk;
+	unsigned int mem_size;
+	const char *name;
+	uint32_t len, load;
+	void *top, *lowmem_top;
+
+	root = fdt_root(fit);
+	if (!root) {
+		SERIAL_ERR(ERR_FIT_BAD_IMAGE);
+		return -1;
+	}
+
+	images = fdt_subnode(root, "images");
+	confs = fdt_subnode(root, "configurations");
+	if (!images || !confs) {
+		SERIAL_ERR(ERR_FIT_BAD_IMAGE);
+		return -1;
+	}
+
+	conf = fdt_subnode(confs, fit_config_name);
+	if (!conf) {
+		name = fdt_getprop(fit, confs, "default", &len);
+		if (name)
+			conf = fdt_subnode(confs, name);
+	}
+	if (!conf) {
+		SERIAL_ERR(ERR_FIT_NO_CONF);
+		return -1;
+	}
+
+	SERIAL_PUTS("FIT: Using configuration ");
+	SERIAL_PUTS((const char *) (conf + 1));
+	SERIAL_PUTC('\n');
+
+	if (fit_get_image(fit, images, conf, "kernel", &kernel) ||
+	    fit_get_image(fit, images, conf, "fdt", &fdt) < 0 ||
+	    fit_get_image(fit, images, conf, "ramdisk", &ramdisk) < 0) {
+		SERIAL_ERR(ERR_FIT_BAD_IMAGE);
+		return -1;
+	}
+
+	load = fdt_getprop_u32(fit, kernel.node, "load", 0);
+	name = fdt_getprop(fit, kernel.node, "compression", &len);
+	if (!load || (name && strncmp(name, "none", 5))) {
+		SERIAL_ERR(ERR_FIT_BAD_IMAGE);
+		return -1;
+	}
+	kernel.dst = (void *) LOADADDR(load);
+
+	/* The device tree and initramfs go to the top of low memory, out of
+	 * reach of the kernel and its decompressor, unless they have a load
+	 * address; the device tree gets room for the command line. */
+	mem_size = get_memory_size();
+	lowmem_top = (void *) LOADADDR(mem_size > LOWMEM_SIZE ?
+				       LOWMEM_SIZE : mem_size);
+	top = lowmem_top;
+
+	if ((ramdisk.node && fit_place(fit, &ramdisk, 0, &top, lowmem_top,
+				       &kernel))
+	    || (fdt.node && fit_place(fit, &fdt, FDT_BOOTARGS_ROOM, &top,
+				      lowmem_top, &kernel))
+	    || (ramdisk.node && fdt.node
+		&& overlaps(fdt.dst, fdt.size + FDT_BOOTARGS_ROOM,
+			    ramdisk.dst, ramdisk.size))) {
+		SERIAL_ERR(ERR_FIT_BAD_IMAGE);
+		return -1;
+	}
+
+	/* The kernel comes last, as it may be moved over the tree. */
+	if ((ramdisk.node && fit_load_image(&ramdisk))
+	    || (fdt.node && fit_load_image(&fdt))
+	    || fit_load_image(&kernel)) {
+		SERIAL_ERR(ERR_FIT_BAD_IMAGE);
+		return -1;
+	}
+
+	if (ramdisk.node) {
+		boot_initrd = ramdisk.dst;
+		boot_initrd_size = ramdisk.size;
+	}
+	if (fdt.node)
+		boot_fdt = fdt.dst;
+
+	*exec_addr = (void *) fdt_getprop_u32(fit, kernel.node, "entry", load);
+	set_boot_kernel(kernel.dst, kernel.size);
+	return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef FIT_H
+#define FIT_H
+
+/*
+ * Called once the tree of a FIT image is complete, at 'fit'. The
+ * configuration named after the hardware variant is used, or the default
+ * one if there is none. The kernel is placed at its load address; the device
+ * tree and the initramfs at their own load address if they have one, at the
+ * top of low memory otherwise. Embedded data is moved there, and external
+ * data gets a segment of the image, with its CRC32 hash.
+ * Returns 0 and writes the entry point to 'exec_addr' on success.
+ */
+int fit_process_tree(const void *fit, void **exec_addr);
+
+/* Name of the FIT configuration matching the hardware variant. */
+extern const char fit_config_name[];
+
+#endif
@@ -59,6 +59,37 @@ static inline void jz_flush_icache(void)
 	}
 }
 
+/* Writes back and invalidates the data cache lines of [start, end). */
+static inline void jz_flush_dcache_range(unsigned long start, unsigned long end)
+{
+	start &= ~(CFG_CACHELINE_SIZE - 1);
+	while (start < end) {
+		cache_unroll(start,Hit_Writeback_Inv_D);
+		start += CFG_CACHELINE_SIZE;
+	}
+}
+
+static inline void jz_flush_icache_range(unsigned long start, unsigned long end)
+{
+	start &= ~(CFG_CACHELINE_SIZE - 1);
+	while (start < end) {
+		cache_unroll(start,Hit_Invalidate_I);
+		start += CFG_CACHELINE_SIZE;
+	}
+}
+
+/* The segment the images are loaded through */
+#ifdef USE_CACHED_LOAD
+#define LOAD_SEG		KSEG0
+#define LOADADDR(a)		KSEG0ADDR(a)
+#else
+#define LOAD_SEG		KSEG1
+#define LOADADDR(a)		KSEG1ADDR(a)
+#endif
+
+/* Highest address the kernel maps as low memory */
+#define LOWMEM_SIZE		0x10000000
+
 /* cpu pipeline flush */
 static inline void jz_sync(void)
 {
@@ -0,0 +1,61 @@
+#ifndef __JZ4740_DMAC_H__
+#define __JZ4740_DMAC_H__
+
+#define DMAC_BASE	0xB3020000
+
+/* Channel registers; on JZ4750 the second controller starts at channel 6. */
+#define DMAC_DSAR(n)	(DMAC_BASE + 0x00 + (n) * 0x20) /* Source Address */
+#define DMAC_DTAR(n)	(DMAC_BASE + 0x04 + (n) * 0x20) /* Target Address */
+#define DMAC_DTCR(n)	(DMAC_BASE + 0x08 + (n) * 0x20) /* Transfer Count */
+#define DMAC_DRSR(n)	(DMAC_BASE + 0x0c + (n) * 0x20) /* Request Source */
+#define DMAC_DCCSR(n)	(DMAC_BASE + 0x10 + (n) * 0x20) /* Control/Status */
+#define DMAC_DCMD(n)	(DMAC_BASE + 0x14 + (n) * 0x20) /* Command */
+
+#define DMAC_DMACR	(DMAC_BASE + 0x300) /* Control */
+#if JZ_VERSION == 4750 || JZ_VERSION == 4725
+#define DMAC_DMACKE	(DMAC_BASE + 0x310) /* Channel Clock Enable */
+#endif
+
+#define REG_DMAC_DSAR(n)	REG32(DMAC_DSAR(n))
+#define REG_DMAC_DTAR(n)	REG32(DMAC_DTAR(n))
+#define REG_DMAC_DTCR(n)	REG32(DMAC_DTCR(n))
+#define REG_DMAC_DRSR(n)	REG32(DMAC_DRSR(n))
+#define REG_DMAC_DCCSR(n)	REG32(DMAC_DCCSR(n))
+#define REG_DMAC_DCMD(n)	REG32(DMAC_DCMD(n))
+#define REG_DMAC_DMACR		REG32(DMAC_DMACR)
+#define REG_DMAC_DMACKE		REG32(DMAC_DMACKE)
+
+/* DMA Request Source Register */
+#define DMAC_DRSR_RS_AUTO	8
+
+/* DMA Channel Control/Status Register */
+#define DMAC_DCCSR_NDES		(1 << 31) /* No descriptor */
+#define DMAC_DCCSR_AR		(1 << 4)  /* Address error */
+#define DMAC_DCCSR_TT		(1 << 3)  /* Transfer terminated */
+#define DMAC_DCCSR_HLT		(1 << 2)  /* Halted */
+#define DMAC_DCCSR_EN		(1 << 0)  /* Channel enable */
+
+/* DMA Channel Command Register */
+#define DMAC_DCMD_SAI		(1 << 23) /* Source address increment */
+#define DMAC_DCMD_DAI		(1 << 22) /* Destination address increment */
+#define DMAC_DCMD_SWDH_BIT	14
+#define DMAC_DCMD_SWDH_32	(0 << DMAC_DCMD_SWDH_BIT)
+#define DMAC_DCMD_SWDH_8	(1 << DMAC_DCMD_SWDH_BIT)
+#define DMAC_DCMD_SWDH_16	(2 << DMAC_DCMD_SWDH_BIT)
+#define DMAC_DCMD_DWDH_BIT	12
+#define DMAC_DCMD_DWDH_32	(0 << DMAC_DCMD_DWDH_BIT)
+#define DMAC_DCMD_DWDH_8	(1 << DMAC_DCMD_DWDH_BIT)
+#define DMAC_DCMD_DWDH_16	(2 << DMAC_DCMD_DWDH_BIT)
+#define DMAC_DCMD_DS_BIT	8
+#define DMAC_DCMD_DS_32BIT	(0 << DMAC_DCMD_DS_BIT)
+#define DMAC_DCMD_DS_8BIT	(1 << DMAC_DCMD_DS_BIT)
+#define DMAC_DCMD_DS_16BIT	(2 << DMAC_DCMD_DS_BIT)
+#define DMAC_DCMD_DS_16BYTE	(3 << DMAC_DCMD_DS_BIT)
+#define DMAC_DCMD_DS_32BYTE	(4 << DMAC_DCMD_DS_BIT)
+
+/* DMA Control Register */
+#define DMAC_DMACR_HLT		(1 << 3)  /* Halted */
+#define DMAC_DMACR_AR		(1 << 2)  /* Address error */
+#define DMAC_DMACR_DMAE		(1 << 0)  /* DMA enable */
+
+#endif /* __JZ4740_DMAC_H__ */
@@ -0,0 +1,59 @@
+#ifndef __JZ4740_TCU_H__
+#define __JZ4740_TCU_H__
+
+#define TCU_BASE	0xB0002000
+
+#define TCU_TER		(TCU_BASE + 0x10) /* Counter Enable */
+#define TCU_TESR	(TCU_BASE + 0x14) /* Counter Enable Set */
+#define TCU_TECR	(TCU_BASE + 0x18) /* Counter Enable Clear */
+#define TCU_TSR		(TCU_BASE + 0x1c) /* Timer Stop */
+#define TCU_TSSR	(TCU_BASE + 0x2c) /* Timer Stop Set */
+#define TCU_TSCR	(TCU_BASE + 0x3c) /* Timer Stop Clear */
+
+/* 16-bit timers */
+#define TCU_TDFR(n)	(TCU_BASE + 0x40 + (n) * 0x10) /* Data FULL */
+#define TCU_TDHR(n)	(TCU_BASE + 0x44 + (n) * 0x10) /* Data HALF */
+#define TCU_TCNT(n)	(TCU_BASE + 0x48 + (n) * 0x10) /* Counter */
+#define TCU_TCSR(n)	(TCU_BASE + 0x4c + (n) * 0x10) /* Control */
+
+/* Operating system timer, JZ4760 and later; bit 15 of TER/TSR. */
+#define TCU_OST		15
+#define OST_OSTDR	(TCU_BASE + 0xe0) /* Data */
+#define OST_OSTCNTL	(TCU_BASE + 0xe4) /* Counter, low word */
+#define OST_OSTCNTH	(TCU_BASE + 0xe8) /* Counter, high word */
+#define OST_OSTCSR	(TCU_BASE + 0xec) /* Control */
+#define OST_OSTCNTH_BUF	(TCU_BASE + 0xfc) /* High word, latched on low read */
+
+#define REG_TCU_TER		REG32(TCU_TER)
+#define REG_TCU_TESR		REG32(TCU_TESR)
+#define REG_TCU_TECR		REG32(TCU_TECR)
+#define REG_TCU_TSR		REG32(TCU_TSR)
+#define REG_TCU_TSSR		REG32(TCU_TSSR)
+#define REG_TCU_TSCR		REG32(TCU_TSCR)
+#define REG_TCU_TDFR(n)		REG32(TCU_TDFR(n))
+#define REG_TCU_TDHR(n)		REG32(TCU_TDHR(n))
+#define REG_TCU_TCNT(n)		REG32(TCU_TCNT(n))
+#define REG_TCU_TCSR(n)		REG32(TCU_TCSR(n))
+#define REG_OST_OSTDR		REG32(OST_OSTDR)
+#define REG_OST_OSTCNTL		REG32(OST_OSTCNTL)
+#define REG_OST_OSTCNTH		REG32(OST_OSTCNTH)
+#define REG_OST_OSTCSR		REG32(OST_OSTCSR)
+#define REG_OST_OSTCNTH_BUF	REG32(OST_OSTCNTH_BUF)
+
+/* Timer Control Register; the OST one has the same low bits */
+#define TCU_TCSR_PWM_EN		(1 << 7)
+#define TCU_TCSR_PRESCALE_BIT	3
+#define TCU_TCSR_PRESCALE1	(0 << TCU_TCSR_PRESCALE_BIT)
+#define TCU_TCSR_PRESCALE4	(1 << TCU_TCSR_PRESCALE_BIT)
+#define TCU_TCSR_PRESCALE16	(2 << TCU_TCSR_PRESCALE_BIT)
+#define TCU_TCSR_PRESCALE64	(3 << TCU_TCSR_PRESCALE_BIT)
+#define TCU_TCSR_PRESCALE256	(4 << TCU_TCSR_PRESCALE_BIT)
+#define TCU_TCSR_PRESCALE1024	(5 << TCU_TCSR_PRESCALE_BIT)
+#define TCU_TCSR_EXT_EN		(1 << 2)
+#define TCU_TCSR_RTC_EN		(1 << 1)
+#define TCU_TCSR_PCK_EN		(1 << 0)
+
+#define OSTCSR_CNT_MD		(1 << 15) /* Wrap at 2^32 (2^64), not OSTDR */
+#define OSTCSR_SD		(1 << 9)  /* Stop abruptly */
+
+#endif /* __JZ4740_TCU_H__ */
@@ -11,22 +11,25 @@
 
 #include "config.h"
 
+#include "bench.h"
 #include "board.h"
 #include "nand.h"
+#include "resume.h"
 #include "serial.h"
+#include "stage2.h"
 #include "ubi.h"
 #include "mmc.h"
 #include "fat.h"
+#include "fdt.h"
+#include "fit.h"
+#include "uimage.h"
+#include "errorcodes.h"
 #include "jz.h"
 #include "utils.h"
+#include "warmboot.h"
 
 #include "jz4740-gpio.h"
 
-/* Time how long UBIBoot takes to do its job.
- * Uses the JZ4770 OST, so won't work on JZ4740.
- */
-#define BENCHMARK 0
-
 /* Kernel parameters list */
 
 /* Fill in root device and file system type? */
@@ -36,10 +39,26 @@
 #define PASS_ROOTFS_PARAMS 0
 #endif
 
+/* Can the loader hand over an initramfs or a device tree? */
+#if defined(USE_FIT) || (defined(USE_UBI) && defined(USE_UBI_INITRD))
+#define PASS_INITRD_PARAMS 1
+#else
+#define PASS_INITRD_PARAMS 0
+#endif
+
+#if defined(USE_FIT) || (defined(USE_UBI) && defined(USE_UBI_FDT))
+#define BOOT_WITH_FDT 1
+#else
+#define BOOT_WITH_FDT 0
+#endif
+
 enum {
 	/* Arguments for the kernel itself. */
 	PARAM_EXEC = 0,
 	PARAM_LOWMEM,
+#ifdef USE_WARMBOOT
+	PARAM_WARMMEM,
+#endif
 #ifdef USES_HIGHMEM
 	PARAM_HIGHMEM,
 #endif
@@ -73,13 +92,17 @@ enum {
 #endif
 #ifdef RFKILL_STATE
 	PARAM_RFKILL_STATE,
+#endif
+#if PASS_INITRD_PARAMS
+	PARAM_INITRD_START,
+	PARAM_INITRD_SIZE,
 #endif
 	/* Arguments for user space (init and later). */
 	PARAM_SEPARATOR,
 	PARAM_HWVARIANT,
 	PARAM_KERNEL_BAK,
 	PARAM_ROOTFS_BAK,
-#if BENCHMARK
+#ifdef USE_BOOTBENCH
 	PARAM_BOOTBENCH,
 #endif
 };
@@ -90,6 +113,9 @@ enum {
 static char *kernel_params[] = {
 	[PARAM_EXEC] = "linux",
 	[PARAM_LOWMEM] = "mem=0x0000M",
+#ifdef USE_WARMBOOT
+	[PARAM_WARMMEM] = "",
+#endif
 #ifdef USES_HIGHMEM
 	[PARAM_HIGHMEM] = "mem=0x0000M@0x30000000",
 #endif
@@ -126,13 +152,17 @@ static char *kernel_params[] = {
 #endif
 #ifdef RFKILL_STATE
 	[PARAM_RFKILL_STATE] = "rfkill.default_state=" STRINGIFY_IND(RFKILL_STATE),
+#endif
+#if PASS_INITRD_PARAMS
+	[PARAM_INITRD_START] = "",
+	[PARAM_INITRD_SIZE] = "",
 #endif
 	[PARAM_SEPARATOR] = "--",
 	[PARAM_HWVARIANT] = "hwvariant=" VARIANT,
 	[PARAM_KERNEL_BAK] = "",
 	[PARAM_ROOTFS_BAK] = "",
-#if BENCHMARK
-	[PARAM_BOOTBENCH] = "bootbench=0x0000000000000000",
+#ifdef USE_BOOTBENCH
+	[PARAM_BOOTBENCH] = "",
 #endif
 };
 
@@ -151,13 +181,82 @@ static void set_logo_param(int show_logo)
 	kernel_params[PARAM_LOGO] = show_logo ? "splash" : "logo.nologo";
 }
 
+#ifdef USE_FIT
+const char fit_config_name[] = VARIANT;
+#endif
+
+#if PASS_INITRD_PARAMS
+static void set_initrd_params(void)
+{
+	static char initrd_start[] = "rd_start=0x00000000";
+	static char initrd_size[] = "rd_size=0x00000000";
+
+	write_hex_digits((unsigned int) KSEG0ADDR(boot_initrd),
+			&initrd_start[sizeof(initrd_start) - 2]);
+	write_hex_digits(boot_initrd_size,
+			&initrd_size[sizeof(initrd_size) - 2]);
+
+	kernel_params[PARAM_INITRD_START] = initrd_start;
+	kernel_params[PARAM_INITRD_SIZE] = initrd_size;
+}
+#endif
+
+static void set_mmc_params(unsigned int mmc)
+{
+	(void) mmc; /* only used with TRY_BOTH_MMCS */
+
+#if PASS_ROOTFS_PARAMS
+#ifdef TRY_BOTH_MMCS
+	if (mmc == 1) {
+		kernel_params[PARAM_ROOTDEV] = "root=/dev/mmcblk1p1";
+	} else
+#endif
+	kernel_params[PARAM_ROOTDEV] = "root=/dev/mmcblk0p1";
+	kernel_params[PARAM_ROOTTYPE] = "rootfstype=vfat";
+	kernel_params[PARAM_ROOTFLAGS] = "rootflags=umask=000";
+#endif
+}
+
+#ifdef USE_UBI
+static void set_ubi_params(void)
+{
+#ifdef UBI_ROOTFS_MTDNAME
+	kernel_params[PARAM_UBIMTD] = "ubi.mtd=" UBI_ROOTFS_MTDNAME;
+#endif
+#if PASS_ROOTFS_PARAMS
+	kernel_params[PARAM_ROOTDEV] = "root=ubi0:" UBI_ROOTFS_VOLUME;
+	kernel_params[PARAM_ROOTTYPE] = "rootfstype=ubifs";
+#endif
+}
+#endif
+
+#ifdef USE_WARMBOOT
+static char warm_below_param[] = "mem=0x00000000";
+static char warm_above_param[] = "mem=0x00000000@0x00000000";
+#endif
+
 static void set_mem_param(void)
 {
 	unsigned int mem_size = get_memory_size() >> 20;
 	unsigned int low_mem_size = mem_size > 256 ? 256 : mem_size;
+#ifdef USE_WARMBOOT
+	uint32_t reserved_end = warm_reserved_end();
+#endif
 
 	write_hex_digits(low_mem_size, &kernel_params[PARAM_LOWMEM][9]);
 
+#ifdef USE_WARMBOOT
+	/* Split the low memory around the image kept for a warm reset. */
+	if (reserved_end) {
+		write_hex_digits(WARM_RESERVED_START, &warm_below_param[13]);
+		write_hex_digits((low_mem_size << 20) - reserved_end,
+				&warm_above_param[13]);
+		write_hex_digits(reserved_end, &warm_above_param[24]);
+		kernel_params[PARAM_LOWMEM] = warm_below_param;
+		kernel_params[PARAM_WARMMEM] = warm_above_param;
+	}
+#endif
+
 #ifdef USES_HIGHMEM
 	unsigned int high_mem_size = mem_size > 256 ? mem_size - 256 : 0;
 	if (high_mem_size) {
@@ -171,10 +270,30 @@ static void set_mem_param(void)
 
 typedef void (*kernel_main)(int, char**, char**, int*) __attribute__((noreturn));
 
+#ifdef USE_CACHED_LOAD
+/* Writes the images back to the SDRAM: an indexed writeback of the whole
+ * data cache costs less than walking them. The instruction cache is only
+ * invalidated over the kernel, as it holds the loader's own code, which the
+ * SDRAM doesn't hold on JZ4760 and later. */
+static void sync_caches(void)
+{
+	jz_flush_dcache();
+	jz_sync();
+	jz_flush_icache_range((unsigned long) boot_kernel,
+			      (unsigned long) boot_kernel + boot_kernel_size);
+}
+#else
+/* Nothing was loaded through the cache. */
+#define sync_caches() do { } while (0)
+#endif
+
 void c_main(void)
 {
 	void *exec_addr = NULL;
 	int mmc_inited, alt_kernel;
+#ifdef USE_WARMBOOT
+	unsigned int source = WARM_SOURCE_NAND, flags;
+#endif
 	extern unsigned int _bss_start, _bss_end;
 	unsigned int *ptr;
 
@@ -182,22 +301,46 @@ void c_main(void)
 	for (ptr = &_bss_start; ptr < &_bss_end; ptr++)
 		*ptr = 0;
 
-#if BENCHMARK
-	/* Setup 3 MHz timer, 64-bit wrap, abrupt stop. */
-	REG_OST_OSTCSR = OSTCSR_CNT_MD | OSTCSR_SD
-				   | OSTCSR_EXT_EN | OSTCSR_PRESCALE4;
-	__tcu_stop_counter(15);
-	REG_OST_OSTCNTL = 0;
-	REG_OST_OSTCNTH = 0;
-	__tcu_start_counter(15);
-#endif
+	bench_start();
 
+	/* Stage 2 runs from the SDRAM, once stage 1 set the board up. */
+#ifndef STAGE2
 	board_init();
+	cache_save_loader();
+#endif
 
-	if (!ram_works()) {
-		SERIAL_PUTS("SDRAM does not work!\n");
-		return;
+#ifdef USE_WARMBOOT
+	/* Before ram_works(), which overwrites the start of the load area */
+	if (!alt_key_pressed()) {
+		exec_addr = warm_boot(&source, &flags);
+		if (exec_addr) {
+			SERIAL_PUTS("Warm reset: kernel still in RAM.\n");
+			if (flags & WARM_FLAG_ALT)
+				set_alt_param();
+#ifdef USE_UBI
+			if (source == WARM_SOURCE_NAND)
+				set_ubi_params();
+			else
+#endif
+				set_mmc_params(source);
+			goto boot;
+		}
+	}
+#endif
+
+#ifndef STAGE2
+#ifdef STAGE2_WARMBOOT
+	/* The RAM test would overwrite the image that stage 2 boots again. */
+	if (!warm_pending())
+#endif
+	{
+		if (!ram_works()) {
+			SERIAL_PUTS("SDRAM does not work!\n");
+			return;
+		}
+		bench_mark(BENCH_RAM_WORKS);
 	}
+#endif
 
 	SERIAL_PUTS("UBIBoot by Paul Cercueil <paul@crapouillou.net>\n");
 #ifdef BKLIGHT_ON
@@ -214,7 +357,8 @@ void c_main(void)
 	 * loader are not marked as dirty initially. Therefore, if those cache
 	 * lines are evicted, the data is lost. To avoid that, we load to the
 	 * uncached kseg1 virtual address region, so we never trigger a cache
-	 * miss and therefore cause no evictions.
+	 * miss and therefore cause no evictions. With USE_CACHED_LOAD, those
+	 * lines were saved to the SDRAM instead, and we load to kseg0.
 	 */
 
 #ifdef TRY_BOTH_MMCS
@@ -226,23 +370,34 @@ void c_main(void)
 #endif
 		mmc_inited = !mmc_init(mmc);
 		if (mmc_inited) {
+			bench_mark(BENCH_MMC_INIT);
+
+#ifdef USE_RESUME
+			/* The alt key boots the system afresh instead. */
+			if (!alt_kernel) {
+				void *entry = mmc_resume(mmc);
+
+				if (entry) {
+					SERIAL_PUTS("Snapshot loaded. Resuming...\n\n");
+					resume_jump(entry);
+				}
+			}
+#endif
+
+#ifdef USE_STAGE2
+			mmc_load_stage2(mmc, alt_kernel, &exec_addr);
+#else
 			if (mmc_load_kernel(
-					mmc, (void *) (KSEG1 + LD_ADDR), alt_kernel,
+					mmc, (void *) (LOAD_SEG + LD_ADDR), alt_kernel,
 					&exec_addr) == 1)
 				set_alt_param();
+#endif
 
 			if (exec_addr) {
-#if PASS_ROOTFS_PARAMS
-#ifdef TRY_BOTH_MMCS
-				if (mmc == 1) {
-					kernel_params[PARAM_ROOTDEV] =
-						"root=/dev/mmcblk1p1";
-				} else
-#endif
-				kernel_params[PARAM_ROOTDEV] =
-						"root=/dev/mmcblk0p1";
-				kernel_params[PARAM_ROOTTYPE] = "rootfstype=vfat";
-				kernel_params[PARAM_ROOTFLAGS] = "rootflags=umask=000";
+				bench_mark(BENCH_MMC_LOAD);
+				set_mmc_params(mmc);
+#ifdef USE_WARMBOOT
+				source = mmc;
 #endif
 			}
 		}
@@ -291,21 +446,18 @@ void c_main(void)
 #ifdef USE_NAND
 	if (!exec_addr) {
 		nand_init();
+#ifdef USE_NAND_ONFI
+		nand_detect();
+#endif
 #ifdef USE_UBI
-		if (ubi_load_kernel((void *) (KSEG1 + LD_ADDR),
-				    &exec_addr, alt_kernel)) {
+		if (ubi_load_kernel(&exec_addr, alt_kernel)) {
 			SERIAL_PUTS("Unable to boot from NAND.\n");
 			return;
 		} else {
+			bench_mark(BENCH_UBI_LOAD);
 			if (alt_kernel)
 				set_alt_param();
-#ifdef UBI_ROOTFS_MTDNAME
-			kernel_params[PARAM_UBIMTD] = "ubi.mtd=" UBI_ROOTFS_MTDNAME;
-#endif
-#if PASS_ROOTFS_PARAMS
-			kernel_params[PARAM_ROOTDEV] = "root=ubi0:" UBI_ROOTFS_VOLUME;
-			kernel_params[PARAM_ROOTTYPE] = "rootfstype=ubifs";
-#endif
+			set_ubi_params();
 		}
 #else /* USE_UBI */
 #warning UBI is currently the only supported NAND file system and it was not selected.
@@ -313,14 +465,20 @@ void c_main(void)
 	}
 #endif /* USE_NAND */
 
-#if BENCHMARK
-	/* Stop timer. */
-	__tcu_stop_counter(15);
-	/* Store timer count in kernel command line. */
-	write_hex_digits(REG_OST_OSTCNTL,
-			&kernel_params[PARAM_BOOTBENCH][27]);
-	write_hex_digits(REG_OST_OSTCNTH_BUF,
-			&kernel_params[PARAM_BOOTBENCH][27 - 8]);
+#ifdef USE_STAGE2
+	/* Stage 2 starts over, reads the keys and loads the kernel. */
+	sync_caches();
+	bench_hand_over();
+	SERIAL_PUTS("Stage 2 loaded. Executing...\n\n");
+	((void (*)(void)) exec_addr)();
+	return;
+#endif
+
+#ifdef USE_WARMBOOT
+boot:
+#endif
+#ifdef USE_BOOTBENCH
+	kernel_params[PARAM_BOOTBENCH] = bench_param();
 #endif
 
 	if (alt2_key_pressed())
@@ -328,15 +486,37 @@ void c_main(void)
 
 	set_logo_param(!alt3_key_pressed());
 	set_mem_param();
-
-	/* Since we load to kseg1, there is no data we want to keep in the cache,
-	 * so no need to flush it to RAM.
-	jz_flush_dcache();
-	jz_flush_icache();
-	*/
+#if PASS_INITRD_PARAMS
+	if (boot_initrd)
+		set_initrd_params();
+#endif
 
 	SERIAL_PUTS("Kernel loaded. Executing...\n\n");
 
+#if BOOT_WITH_FDT
+	/* UHI boot protocol: with a device tree, the command line has to be
+	 * passed through its /chosen node. */
+	if (boot_fdt && fdt_set_bootargs(boot_fdt, &kernel_params[1],
+					 ARRAY_SIZE(kernel_params) - 1)) {
+		SERIAL_ERR(ERR_FIT_BOOTARGS);
+		return;
+	}
+#endif
+
+#ifdef USE_WARMBOOT
+	warm_save(exec_addr, source,
+		  kernel_params[PARAM_KERNEL_BAK][0] ? WARM_FLAG_ALT : 0);
+#endif
+
+	sync_caches();
+
+#if BOOT_WITH_FDT
+	if (boot_fdt) {
+		((kernel_main) exec_addr) (
+				-2, (char **) KSEG0ADDR(boot_fdt), NULL, NULL);
+	}
+#endif
+
 	/* Boot the kernel */
 	((kernel_main) exec_addr) (
 			ARRAY_SIZE(kernel_params), kernel_params, NULL, NULL );
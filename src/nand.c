@@ -16,9 +16,18 @@
 #include "config.h"
 #include "errorcodes.h"
 #include "jz.h"
+#include "utils.h"
 
 #include "jz4740-emc.h"
 
+#ifdef USE_NAND_ONFI
+#include "jz4740-cpm.h"
+#endif
+
+#ifdef USE_NAND_DMA
+#include "dma.h"
+#endif
+
 /*
  * NAND flash definitions
  */
@@ -37,6 +46,9 @@
 
 #define OOB_SIZE 	(PAGE_SIZE / 32)
 
+/* Zero bits tolerated in the parity bytes of an erased ECC block */
+#define NAND_ERASED_MAX_BITFLIPS	2
+
 /*
  * NAND flash routines
  */
@@ -61,113 +73,582 @@ static void nand_read_buf(void *buf, size_t count)
 }
 #endif
 
-static void nand_read_oob(uint32_t page_addr, uint8_t *buf, size_t size)
+/* Reads one ECC block, feeding the ECC engine on the way. */
+#if (BUS_WIDTH == 16)
+static void nand_read_ecc_block(uint8_t *buf)
 {
-	int col_addr;
+	size_t i;
+	u16 *p = (u16 *)buf;
 
-#if (PAGE_SIZE == 512)
-	col_addr = 0;
-	nand_wait_ready();
+	bch_start_block();
 
-	/* Send READOOB command */
-	__nand_cmd(NAND_CMD_READOOB);
-#else
-	col_addr = PAGE_SIZE;
+	for (i = 0; i < ECC_BLOCK; i += 2) {
+		u16 val = __nand_data16();
 
-	/* Send READ0 command */
-	__nand_cmd(NAND_CMD_READ0);
+		*p++ = val;
+		bch_feed(val & 0xff);
+		bch_feed(val >> 8);
+	}
+}
+#elif (BUS_WIDTH == 8)
+static void nand_read_ecc_block(uint8_t *buf)
+{
+	size_t i;
+
+	bch_start_block();
+
+	for (i = 0; i < ECC_BLOCK; i++) {
+		u8 val = __nand_data8();
+
+		*buf++ = val;
+		bch_feed(val);
+	}
+}
 #endif
 
-	/* Send column address */
-	__nand_addr(col_addr & 0xff);
+/* Change column setup time, in ns: from RNDOUTSTART to the first data. */
+#ifndef NAND_TCCS
+#define NAND_TCCS	500	/* ONFI timing mode 0 */
+#endif
 
-#if (PAGE_SIZE != 512)
-	__nand_addr((col_addr >> 8) & 0xff);
+#ifdef USE_NAND_ONFI
+static unsigned int row_cycles = ROW_CYCLE;
+static unsigned int t_ccs = NAND_TCCS;
+#else
+#define row_cycles ROW_CYCLE
+#define t_ccs NAND_TCCS
 #endif
 
-	/* Send page address */
+static void nand_send_row(uint32_t page_addr)
+{
 	__nand_addr(page_addr & 0xff);
 	__nand_addr((page_addr >> 8) & 0xff);
 
-#if (ROW_CYCLE == 3)
-	__nand_addr((page_addr >> 16) & 0xff);
-#endif
+	if (row_cycles == 3)
+		__nand_addr((page_addr >> 16) & 0xff);
+}
 
 #if (PAGE_SIZE != 512)
+static void nand_read_cmd(uint32_t page_addr, unsigned int col_addr)
+{
+	/* Send READ0 command */
+	__nand_cmd(NAND_CMD_READ0);
+
+	/* Send column address */
+	__nand_addr(col_addr & 0xff);
+	__nand_addr((col_addr >> 8) & 0xff);
+
+	/* Send page address */
+	nand_send_row(page_addr);
+
 	/* Send READSTART command for 2048 or 4096 ps NAND */
 	__nand_cmd(NAND_CMD_READSTART);
+
+	/* Wait for device ready */
+	nand_wait_ready();
+}
+
+/* Moves the read pointer within the page register, without reloading it. */
+static void nand_set_column(unsigned int col_addr)
+{
+	__nand_cmd(NAND_CMD_RNDOUT);
+	__nand_addr(col_addr & 0xff);
+	__nand_addr((col_addr >> 8) & 0xff);
+	__nand_cmd(NAND_CMD_RNDOUTSTART);
+	ndelay(t_ccs);
+}
 #endif
 
+static void nand_read_oob(uint32_t page_addr, uint8_t *buf, size_t size)
+{
+#if (PAGE_SIZE == 512)
+	nand_wait_ready();
+
+	/* Send READOOB command */
+	__nand_cmd(NAND_CMD_READOOB);
+
+	/* Send column address */
+	__nand_addr(0);
+
+	/* Send page address */
+	nand_send_row(page_addr);
+
 	/* Wait for device ready */
 	nand_wait_ready();
 
 	/* Read oob data */
 	nand_read_buf(buf, size);
 
-#if (PAGE_SIZE == 512)
 	nand_wait_ready();
+#else
+	nand_read_cmd(page_addr, PAGE_SIZE);
+
+	/* Read oob data */
+	nand_read_buf(buf, size);
 #endif
 }
 
-static void __nand_read_page(uint32_t page_addr, uint8_t *dst, uint8_t *oobbuf)
+/*
+ * Erased pages have all-0xff parity bytes, which don't decode; a few bits
+ * may have flipped since the erase.
+ */
+static int nand_parity_erased(const uint8_t *parity)
+{
+	unsigned int i, flips = 0;
+
+	for (i = 0; i < PAR_SIZE; i++) {
+		uint8_t val = ~parity[i];
+
+		for (; val; val &= val - 1)
+			flips++;
+	}
+
+	return flips <= NAND_ERASED_MAX_BITFLIPS;
+}
+
+static void nand_correct_block(uint8_t *dst, uint8_t *parity)
+{
+	if (!nand_parity_erased(parity))
+		bch_correct_block(dst, parity);
+}
+
+#ifdef USE_NAND_DMA
+/* The DMAC writes to memory directly, bypassing the cache. */
+#ifdef USE_CACHED_LOAD
+/* A kseg0 page is flushed from the cache first, so it must not share a cache
+ * line with other data. */
+#define nand_dma_ok(buf)	(KSEGX(buf) == KSEG1 ? !((uintptr_t)(buf) & 3) : \
+				 !((uintptr_t)(buf) & (CFG_CACHELINE_SIZE - 1)))
+#else
+#define nand_dma_ok(buf)	(KSEGX(buf) == KSEG1 && !((uintptr_t)(buf) & 3))
+#endif
+
+static void nand_read_block_dma(uint8_t *dst)
+{
+	dma_start_read(dst, NAND_DATAPORT, ECC_BLOCK, BUS_WIDTH);
+}
+
+static void nand_wait_block_dma(void)
+{
+	if (dma_wait())
+		SERIAL_ERR(ERR_NAND_DMA);
+}
+
+/*
+ * The RS decoder snoops the bus, so it has to see the whole transfer: the
+ * blocks can't be overlapped. The BCH engine of the JZ4750 would have to be
+ * fed from RAM in a second pass, which is why DMA is only used on the JZ4740.
+ */
+static void nand_read_data_dma(uint8_t *dst, uint8_t *oobbuf)
 {
 	unsigned int i;
 
+	for (i = 0; i < PAGE_SIZE / ECC_BLOCK; i++) {
+		bch_start_block();
+		nand_read_block_dma(dst);
+		nand_wait_block_dma();
+		nand_correct_block(dst, oobbuf + ECC_POS + i * PAR_SIZE);
+
+		dst += ECC_BLOCK;
+	}
+}
+#endif /* USE_NAND_DMA */
+
+/* Reads and corrects the data area, once the OOB area has been read. */
+static void nand_read_data(uint8_t *dst, uint8_t *oobbuf)
+{
+	unsigned int i;
+
+	/* Don't even transfer pages that were never programmed. */
+	for (i = 0; i < PAGE_SIZE / ECC_BLOCK; i++) {
+		if (!nand_parity_erased(oobbuf + ECC_POS + i * PAR_SIZE))
+			break;
+	}
+	if (i == PAGE_SIZE / ECC_BLOCK) {
+		memset(dst, 0xff, PAGE_SIZE);
+		return;
+	}
+
+#ifdef USE_NAND_DMA
+	if (nand_dma_ok(dst)) {
+#ifdef USE_CACHED_LOAD
+		if (KSEGX(dst) == KSEG0)
+			jz_flush_dcache_range((unsigned long) dst,
+					      (unsigned long) dst + PAGE_SIZE);
+#endif
+		nand_read_data_dma(dst, oobbuf);
+		return;
+	}
+#endif
+
+	for (i = 0; i < PAGE_SIZE / ECC_BLOCK; i++) {
+		/* Read data */
+		nand_read_ecc_block(dst);
+
+		/* Correct data */
+		nand_correct_block(dst, oobbuf + ECC_POS + i * PAR_SIZE);
+
+		dst += ECC_BLOCK;
+	}
+}
+
+#ifdef USE_UBI
+static uint32_t crc_value;
+static size_t crc_left;
+
+void nand_crc_start(uint32_t crc, size_t len)
+{
+	crc_value = crc;
+	crc_left = len;
+}
+
+uint32_t nand_crc_end(void)
+{
+	crc_left = 0;
+	return crc_value;
+}
+
+/* Runs the page just read through the CRC while it is still fresh. */
+static void nand_crc_page(const uint8_t *dst)
+{
+	size_t len = crc_left < PAGE_SIZE ? crc_left : PAGE_SIZE;
+
+	if (len) {
+		crc_value = crc32(crc_value, dst, len);
+		crc_left -= len;
+	}
+}
+#else
+#define nand_crc_page(dst) do { } while (0)
+#endif
+
+static void __nand_read_page(uint32_t page_addr, uint8_t *dst, uint8_t *oobbuf)
+{
 	/* Read oob data */
 	nand_read_oob(page_addr, oobbuf, OOB_SIZE);
 
+#if (PAGE_SIZE == 512)
 	/* Send READ0 command */
 	__nand_cmd(NAND_CMD_READ0);
 
 	/* Send column address */
 	__nand_addr(0);
-#if (PAGE_SIZE != 512)
-	__nand_addr(0);
-#endif
 
 	/* Send page address */
-	__nand_addr(page_addr & 0xff);
-	__nand_addr((page_addr >> 8) & 0xff);
-#if (ROW_CYCLE == 3)
-	__nand_addr((page_addr >> 16) & 0xff);
+	nand_send_row(page_addr);
+
+	/* Wait for device ready */
+	nand_wait_ready();
+#else
+	/* The whole page is still in the data register since the OOB read;
+	 * move the column back to the start of the page instead of loading
+	 * the array again. */
+	nand_set_column(0);
 #endif
 
-	/* Send READSTART command for 2048 or 4096 ps NAND */
-#if (PAGE_SIZE != 512)
-	__nand_cmd(NAND_CMD_READSTART);
+	nand_read_data(dst, oobbuf);
+	nand_crc_page(dst);
+}
+
+#if (PAGE_SIZE != 512) && (defined(NAND_CACHE_READ) || defined(USE_NAND_ONFI))
+#define NAND_HAS_CACHE_READ
+
+#ifdef NAND_CACHE_READ
+#define cache_read 1
+#else
+static int cache_read; /* set from the ONFI parameter page */
 #endif
 
-	/* Wait for device ready */
-	nand_wait_ready();
+/*
+ * READ CACHE SEQUENTIAL: while a page is transferred out of the cache
+ * register, the chip already loads the next one from the array.
+ */
+static void nand_load_cached(uint32_t page_start, size_t nb, uint8_t *dst,
+			     uint8_t *oobbuf)
+{
+	nand_read_cmd(page_start, 0);
 
-	for (i = 0; i < PAGE_SIZE / ECC_BLOCK; i++) {
-		/* Read data */
-		nand_read_buf(dst, ECC_BLOCK);
+	while (nb--) {
+		/* Start loading the next page, unless this one is the last. */
+		__nand_cmd(nb ? NAND_CMD_READCACHESEQ : NAND_CMD_READCACHEEND);
+		nand_wait_ready();
 
-		/* Correct data */
-		bch_correct_block(dst, oobbuf + ECC_POS + i * PAR_SIZE);
+		nand_set_column(PAGE_SIZE);
+		nand_read_buf(oobbuf, OOB_SIZE);
+		nand_set_column(0);
+		nand_read_data(dst, oobbuf);
+		nand_crc_page(dst);
 
-		dst += ECC_BLOCK;
+		dst += PAGE_SIZE;
 	}
 }
+#endif
 
 void nand_read_page(uint32_t page, uint8_t *dst)
 {
 	uint8_t oob_buf[OOB_SIZE];
 
 	__nand_enable();
+#ifdef USE_NAND_DMA
+	dma_init();
+#endif
 	__nand_read_page(page, dst, oob_buf);
 	__nand_disable();
 }
 
+void nand_read_subpage(uint32_t page, unsigned int block, uint8_t *dst)
+{
+#if (PAGE_SIZE == 512)
+	nand_read_page(page, dst);
+#else
+	uint8_t parity[PAR_SIZE];
+
+	__nand_enable();
+
+	/* Only fetch the parity bytes of that block, then the block itself. */
+	nand_read_cmd(page, PAGE_SIZE + ECC_POS + block * PAR_SIZE);
+	nand_read_buf(parity, PAR_SIZE);
+
+	if (nand_parity_erased(parity)) {
+		memset(dst, 0xff, ECC_BLOCK);
+	} else {
+		nand_set_column(block * ECC_BLOCK);
+		nand_read_ecc_block(dst);
+		bch_correct_block(dst, parity);
+	}
+
+	__nand_disable();
+#endif
+}
+
+#if (PAGE_SIZE != 512)
+void nand_read_raw(uint32_t page, unsigned int col, uint8_t *buf, size_t len)
+{
+	__nand_enable();
+	nand_read_cmd(page, col);
+	nand_read_buf(buf, len);
+	__nand_disable();
+}
+#endif
+
+#ifdef BAD_BLOCK_POS
+int nand_block_is_bad(uint32_t block)
+{
+	uint32_t page = block * PAGE_PER_BLOCK + BAD_BLOCK_PAGE;
+	uint8_t marker[OOB_SIZE];
+
+	__nand_enable();
+#if (PAGE_SIZE == 512)
+	nand_read_oob(page, marker, OOB_SIZE);
+#else
+	nand_read_cmd(page, PAGE_SIZE + BAD_BLOCK_POS);
+	nand_read_buf(marker + BAD_BLOCK_POS, BUS_WIDTH / 8);
+#endif
+	__nand_disable();
+
+	return marker[BAD_BLOCK_POS] != 0xff;
+}
+#endif
+
 void nand_load(uint32_t page_start, size_t nb, uint8_t *dst)
 {
 	uint8_t oob_buf[OOB_SIZE];
 
 	__nand_enable();
+#ifdef USE_NAND_DMA
+	dma_init();
+#endif
+#ifdef NAND_HAS_CACHE_READ
+	if (cache_read && nb > 1) {
+		nand_load_cached(page_start, nb, dst, oob_buf);
+		nb = 0;
+	}
+#endif
 	while (nb--) {
 		__nand_read_page(page_start++, dst, oob_buf);
 		dst += PAGE_SIZE;
 	}
 	__nand_disable();
 }
+
+#ifdef USE_NAND_ONFI
+#define ONFI_PARAM_COPIES	3
+#define ONFI_CRC_BASE		0x4f4e
+#define ONFI_CRC_POLY		0x8005
+
+/* Parameter page fields found at the same place in JEDEC (JESD230) pages */
+#define ONFI_FEATURES		6	/* bit 0: 16-bit data bus */
+#define ONFI_OPT_CMDS		8	/* bit 1: read cache commands */
+#define ONFI_PAGE_SIZE		80
+#define ONFI_PAGES_PER_BLOCK	92
+#define ONFI_ADDR_CYCLES	101	/* column << 4 | row */
+
+/* Where the two standards differ */
+struct param_page {
+	char sig[6];		/* READID answer */
+	uint8_t id_addr;
+	uint8_t param_addr;
+	uint16_t size;
+	uint16_t timing_modes;	/* JEDEC speed grades: the same bits */
+	uint16_t t_ccs;		/* ns */
+};
+
+static const struct param_page param_pages[] = {
+	{ "ONFI", 0x20, 0x00, 256, 129, 139 },
+	{ "JEDEC", 0x40, 0x40, 512, 144, 161 },
+};
+
+#define PARAM_PAGE_MAX_SIZE	512
+
+/*
+ * Asynchronous timings of the ONFI modes 0 to 5, in ns: RE# pulse width
+ * (max of tRP, tREA), RE# high hold (tREH), CLE/ALE setup (tCLS, tALS) and
+ * hold (tCLH, tALH).
+ */
+static const uint8_t onfi_timings[][4] = {
+	{ 50, 30, 50, 20 },
+	{ 30, 15, 25, 10 },
+	{ 25, 15, 15, 10 },
+	{ 20, 10, 10,  5 },
+	{ 20, 10, 10,  5 },
+	{ 16,  7, 10,  5 },
+};
+
+static uint16_t onfi_crc16(const uint8_t *buf, size_t len)
+{
+	uint16_t crc = ONFI_CRC_BASE;
+	unsigned int i;
+
+	while (len--) {
+		crc ^= *buf++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc << 1) ^ ((crc & 0x8000) ? ONFI_CRC_POLY : 0);
+	}
+
+	return crc;
+}
+
+static uint32_t onfi_get32(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+/* The parameter page is always transferred on the lower 8 bits. */
+static void onfi_read_buf(uint8_t *buf, size_t count)
+{
+	while (count--) {
+#if (BUS_WIDTH == 16)
+		*buf++ = __nand_data16() & 0xff;
+#else
+		*buf++ = __nand_data8();
+#endif
+	}
+}
+
+static unsigned int onfi_cycles(unsigned int ns, unsigned int mhz)
+{
+	return (ns * mhz + 999) / 1000;
+}
+
+static void onfi_set_timings(unsigned int mode)
+{
+	unsigned int mhz = __cpm_get_mclk() / 1000000;
+	unsigned int taw = onfi_cycles(onfi_timings[mode][0], mhz);
+	unsigned int strv = onfi_cycles(onfi_timings[mode][1], mhz);
+	unsigned int tas = onfi_cycles(onfi_timings[mode][2], mhz);
+	unsigned int tah = onfi_cycles(onfi_timings[mode][3], mhz);
+
+	/* TAW is only linear up to 10 cycles; keep the board's timings if
+	 * the part is too slow for what the fields can express. */
+	if (taw > 10 || strv > 15 || tas > 7 || tah > 7)
+		return;
+
+	REG_EMC_SMCR1 = (REG_EMC_SMCR1 & ~(EMC_SMCR_STRV_MASK |
+			EMC_SMCR_TAW_MASK | EMC_SMCR_TAH_MASK | EMC_SMCR_TAS_MASK))
+		| strv << EMC_SMCR_STRV_BIT | taw << EMC_SMCR_TAW_BIT
+		| tah << EMC_SMCR_TAH_BIT | tas << EMC_SMCR_TAS_BIT;
+}
+
+/* Returns non-zero if READID at 'addr' answers 'sig'. */
+static int onfi_read_sig(uint8_t addr, const char *sig)
+{
+	uint8_t c;
+
+	__nand_cmd(NAND_CMD_READID);
+	__nand_addr(addr);
+
+	for (; *sig; sig++) {
+		onfi_read_buf(&c, 1);
+		if (c != *sig)
+			return 0;
+	}
+
+	return 1;
+}
+
+void nand_detect(void)
+{
+	uint8_t param[PARAM_PAGE_MAX_SIZE];
+	const struct param_page *pp;
+	unsigned int i, mode, crc;
+	uint16_t modes, tccs;
+
+	__nand_enable();
+
+	for (pp = param_pages; !onfi_read_sig(pp->id_addr, pp->sig); pp++) {
+		if (pp == &param_pages[ARRAY_SIZE(param_pages) - 1]) {
+			__nand_disable();
+			return;
+		}
+	}
+
+	__nand_cmd(NAND_CMD_PARAM);
+	__nand_addr(pp->param_addr);
+	nand_wait_ready();
+
+	/* Use the first copy of the page that passes its CRC check, which
+	 * covers all of it but the CRC itself. */
+	crc = pp->size - 2;
+	for (i = 0; i < ONFI_PARAM_COPIES; i++) {
+		onfi_read_buf(param, pp->size);
+		if (onfi_crc16(param, crc) == (param[crc] | param[crc + 1] << 8))
+			break;
+	}
+
+	__nand_disable();
+
+	if (i == ONFI_PARAM_COPIES) {
+		SERIAL_ERR(ERR_NAND_ONFI);
+		return;
+	}
+
+	/* The layout of the data is still fixed at build time. */
+	if (onfi_get32(param + ONFI_PAGE_SIZE) != PAGE_SIZE
+			|| onfi_get32(param + ONFI_PAGES_PER_BLOCK) != PAGE_PER_BLOCK
+			|| (param[ONFI_FEATURES] & 1) != (BUS_WIDTH == 16)
+			|| (param[ONFI_ADDR_CYCLES] & 0xf) < 2
+			|| (param[ONFI_ADDR_CYCLES] & 0xf) > 3) {
+		SERIAL_ERR(ERR_NAND_GEOMETRY);
+		return;
+	}
+
+	row_cycles = param[ONFI_ADDR_CYCLES] & 0xf;
+
+	/* Zero for parts that only take the mode 0 value. */
+	tccs = param[pp->t_ccs] | param[pp->t_ccs + 1] << 8;
+	if (tccs)
+		t_ccs = tccs;
+
+#ifdef NAND_HAS_CACHE_READ
+	cache_read = !!(param[ONFI_OPT_CMDS] & 2);
+#endif
+
+	modes = param[pp->timing_modes] | param[pp->timing_modes + 1] << 8;
+	for (mode = ARRAY_SIZE(onfi_timings) - 1; mode; mode--) {
+		if (modes & (1 << mode))
+			break;
+	}
+
+	onfi_set_timings(mode);
+}
+#endif /* USE_NAND_ONFI */
@@ -24,10 +24,13 @@
 #define NAND_CMD_RNDIN		0x85
 #define NAND_CMD_READID		0x90
 #define NAND_CMD_ERASE2		0xd0
+#define NAND_CMD_PARAM		0xec
 #define NAND_CMD_RESET		0xff
 
 /* Extended commands for large page devices */
 #define NAND_CMD_READSTART	0x30
+#define NAND_CMD_READCACHESEQ	0x31
+#define NAND_CMD_READCACHEEND	0x3f
 #define NAND_CMD_RNDOUTSTART	0xE0
 #define NAND_CMD_CACHEDPROG	0x15
 
@@ -51,7 +54,30 @@
 #define NAND_MFR_MICRON		0x2c
 
 void nand_init(void);
+
+/*
+ * Reads the ONFI or JEDEC parameter page, if the chip has one, and switches to
+ * the fastest EMC timings and to the address cycles it supports.
+ */
+void nand_detect(void);
 void nand_read_page(uint32_t page, uint8_t *dst);
+
+/* Reads the ECC block number 'block' of the page; ECC_BLOCK bytes. */
+void nand_read_subpage(uint32_t page, unsigned int block, uint8_t *dst);
+/* Reads 'len' bytes from column 'col' of the page, without ECC. */
+void nand_read_raw(uint32_t page, unsigned int col, uint8_t *buf, size_t len);
+
+/* Returns non-zero if the erase block carries a factory bad block marker. */
+int nand_block_is_bad(uint32_t block);
+
 void nand_load(uint32_t page_start, size_t nb, uint8_t *dst);
 
+/*
+ * While armed, the first 'len' bytes that nand_read_page() and nand_load()
+ * return are also run through crc32(), starting from 'crc', as each page
+ * comes in. nand_crc_end() disarms it and returns the CRC.
+ */
+void nand_crc_start(uint32_t crc, size_t len);
+uint32_t nand_crc_end(void);
+
 #endif /* __NAND_H__ */
@@ -0,0 +1,224 @@
+/*
+ * Resume from hibernation: the snapshot of the RAM written to a dedicated
+ * SD partition is loaded back in place of a kernel.
+ *
+ * Layout of the partition, in 512-byte sectors:
+ *   - the header;
+ *   - groups made of an index sector, listing the page frame numbers of
+ *     RESUME_INDEX_PFNS pages (fewer in the last group only), followed by
+ *     the data of those pages.
+ *
+ * Only low memory can be restored, as high memory is not mapped here.
+ *
+ * The snapshot is only read: the system is expected to clear the magic once
+ * resumed, or when booting normally. Should it fail to, a snapshot is still
+ * only used with the kernel file it was taken with.
+ */
+
+#include <stdint.h>
+
+#include "board.h"
+#include "config.h"
+#include "errorcodes.h"
+#include "fat.h"
+#include "jz.h"
+#include "mmc.h"
+#include "resume.h"
+#include "serial.h"
+#include "utils.h"
+
+#define RESUME_MAGIC		0x4d555352	/* "RSUM" */
+#define RESUME_VERSION		3
+
+#define RESUME_PAGE_SIZE	4096
+#define RESUME_PAGE_SECTORS	(RESUME_PAGE_SIZE / MMC_SECTOR_SIZE)
+#define RESUME_INDEX_PFNS	(MMC_SECTOR_SIZE / sizeof(uint32_t) - 1)
+
+/* REG_MSC_NOB is 16-bit wide */
+#define RESUME_MAX_BLOCKS	0xffff
+
+struct resume_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t mem_size;	/* bytes of RAM of the hibernated system */
+	uint32_t nb_pages;
+	uint32_t entry;		/* resume trampoline, in kseg0 */
+	uint32_t data_crc;	/* of all the sectors after the header */
+	uint32_t kernel_crc;	/* of the kernel file; see mmc_kernel_crc() */
+	uint32_t crc;		/* of all the fields above */
+};
+
+struct resume_index {
+	uint32_t nb_pages;
+	uint32_t pfn[RESUME_INDEX_PFNS];
+};
+
+/* Multiple-block read split into transfers the MSC can count. */
+struct resume_reader {
+	unsigned int id;
+	uint32_t lba;		/* of the next sector */
+	uint32_t left;		/* sectors to read in all */
+	uint32_t chunk;		/* sectors left in the current transfer */
+};
+
+static void start_chunk(struct resume_reader *rd)
+{
+	rd->chunk = rd->left < RESUME_MAX_BLOCKS ? rd->left : RESUME_MAX_BLOCKS;
+	mmc_start_block(rd->id, rd->lba, rd->chunk);
+}
+
+static int read_sector(struct resume_reader *rd, uint32_t *buf)
+{
+	if (!rd->left)
+		return -1;
+
+	if (!rd->chunk) {
+		mmc_stop_block(rd->id);
+		start_chunk(rd);
+	}
+
+	rd->lba++;
+	rd->left--;
+	rd->chunk--;
+	return mmc_receive_block(rd->id, buf);
+}
+
+static int find_partition(unsigned int id, uint32_t *buf, uint32_t *lba)
+{
+	struct mbr *mbr = (struct mbr *) buf;
+	unsigned int i;
+
+	if (mmc_block_read(id, buf, 0, 1)) {
+		SERIAL_ERR(ERR_RESUME_IO);
+		return -1;
+	}
+
+	if (mbr->signature != 0xAA55)
+		return -1;
+
+	for (i = 0; i < 4; i++) {
+		if (mbr->partitions[i].type == RESUME_PART_TYPE) {
+			*lba = mbr->partitions[i].lba;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static int check_header(const struct resume_header *hdr, uint32_t mem_size,
+			uint32_t lowmem_size)
+{
+	if (hdr->magic != RESUME_MAGIC || hdr->crc != crc32(0xffffffff, hdr,
+				offsetof(struct resume_header, crc)))
+		return -1;
+
+	/* A snapshot made with another mem= can't be laid out again. */
+	if (hdr->version != RESUME_VERSION || hdr->mem_size != mem_size
+	    || !hdr->nb_pages || hdr->nb_pages > lowmem_size / RESUME_PAGE_SIZE
+	    || hdr->entry < KSEG0 || hdr->entry >= KSEG0 + lowmem_size)
+		return -1;
+
+	return 0;
+}
+
+void *mmc_resume(unsigned int id)
+{
+	uint32_t buf[MMC_SECTOR_SIZE >> 2];
+	uint32_t scratch[MMC_SECTOR_SIZE >> 2];
+	struct resume_header *hdr = (void *) buf;
+	struct resume_index *index = (void *) buf;
+	struct resume_reader rd;
+	uint32_t lba, mem_size = get_memory_size();
+	uint32_t lowmem_size = mem_size > LOWMEM_SIZE ? LOWMEM_SIZE : mem_size;
+	uint32_t nb_pages, data_crc, kernel_crc, crc = 0xffffffff;
+	void *entry;
+	int err = 0;
+
+	if (find_partition(id, buf, &lba))
+		return NULL;
+
+	if (mmc_block_read(id, buf, lba, 1)) {
+		SERIAL_ERR(ERR_RESUME_IO);
+		return NULL;
+	}
+
+	if (check_header(hdr, mem_size, lowmem_size))
+		return NULL;
+
+	entry = (void *) hdr->entry;
+	nb_pages = hdr->nb_pages;
+	data_crc = hdr->data_crc;	/* checked once everything is in */
+	kernel_crc = hdr->kernel_crc;
+
+	/* The kernel may have been replaced since the system hibernated. */
+	if (mmc_kernel_crc(id, (void *) (LOAD_SEG + LD_ADDR), &crc)
+	    || crc != kernel_crc)
+		return NULL;
+
+	SERIAL_PUTS("MMC: Resuming from hibernation.\n");
+
+	rd.id = id;
+	rd.lba = lba + 1;
+	rd.left = div_round_up(nb_pages, RESUME_INDEX_PFNS)
+		+ nb_pages * RESUME_PAGE_SECTORS;
+	start_chunk(&rd);
+
+	crc = 0xffffffff;
+
+	/* Pages are received in a cached buffer to compute the CRC there,
+	 * then written to their frame through kseg1: the loader still lives
+	 * in the cache, and must not be evicted. */
+	while (nb_pages && !err) {
+		unsigned int i, j;
+
+		if (read_sector(&rd, buf)) {
+			err = ERR_RESUME_IO;
+			break;
+		}
+		crc = crc32(crc, buf, MMC_SECTOR_SIZE);
+
+		/* Only the last group may be partial: the sector count of the
+		 * snapshot was computed from the number of pages. */
+		if (index->nb_pages != (nb_pages < RESUME_INDEX_PFNS
+					? nb_pages : RESUME_INDEX_PFNS)) {
+			err = ERR_RESUME_BAD_IMAGE;
+			break;
+		}
+
+		for (i = 0; i < index->nb_pages && !err; i++) {
+			uint32_t pfn = index->pfn[i];
+			uint8_t *dst = (uint8_t *) KSEG1 + pfn * RESUME_PAGE_SIZE;
+
+			/* Above low memory, kseg1 no longer maps the RAM. */
+			if (pfn >= lowmem_size / RESUME_PAGE_SIZE) {
+				err = ERR_RESUME_BAD_IMAGE;
+				break;
+			}
+
+			for (j = 0; j < RESUME_PAGE_SECTORS; j++) {
+				if (read_sector(&rd, scratch)) {
+					err = ERR_RESUME_IO;
+					break;
+				}
+				crc = crc32(crc, scratch, MMC_SECTOR_SIZE);
+				memcpy(dst + j * MMC_SECTOR_SIZE, scratch,
+				       MMC_SECTOR_SIZE);
+			}
+		}
+
+		nb_pages -= index->nb_pages;
+	}
+
+	mmc_stop_block(id);
+
+	if (!err && data_crc != crc)
+		err = ERR_RESUME_BAD_IMAGE;
+
+	if (err) {
+		SERIAL_ERR(err);
+		return NULL;
+	}
+
+	return entry;
+}
@@ -0,0 +1,21 @@
+#ifndef RESUME_H
+#define RESUME_H
+
+/*
+ * Looks for a hibernation snapshot in the SD partition of type
+ * RESUME_PART_TYPE. If its header is valid and was made on a system with
+ * the same amount of RAM, booted from the kernel file now on the card,
+ * streams its pages into their physical frames and returns the entry point
+ * of the resume trampoline. Returns NULL when there
+ * is nothing to resume, or the snapshot got rejected; the RAM content is
+ * then undefined, and the kernel must be loaded anew.
+ */
+void *mmc_resume(unsigned int id);
+
+/*
+ * Drops the loader from both caches without writing anything back, as the
+ * SDRAM now holds the resumed system, then jumps to 'entry'.
+ */
+void resume_jump(void *entry) __attribute__((noreturn));
+
+#endif
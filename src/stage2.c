@@ -0,0 +1,74 @@
+/*
+ * Stage 1 of a two-stage boot: stage 2 is a full build of the loader, linked
+ * to run from the SDRAM, which gets loaded like a kernel would.
+ */
+
+#include <stdint.h>
+
+#include "config.h"
+#include "errorcodes.h"
+#include "mmc.h"
+#include "serial.h"
+#include "stage2.h"
+#include "uimage.h"
+#include "utils.h"
+
+int mmc_load_stage2(unsigned int id, int alt, void **exec_addr)
+{
+	uint32_t scratch[MMC_SECTOR_SIZE >> 2];
+	uint32_t start = STAGE2_MMC_SECTOR + !!alt * STAGE2_MMC_NB_SECTORS;
+	uint32_t offset, nb_sectors;
+	void *entry;
+	int err = 0;
+
+	if (mmc_block_read(id, scratch, start, 1)) {
+		SERIAL_ERR(ERR_STAGE2_IO);
+		return -1;
+	}
+
+	if (process_image_header(scratch, &entry, MMC_SECTOR_SIZE)) {
+		SERIAL_ERR(ERR_STAGE2_BAD_IMAGE);
+		return -1;
+	}
+
+	nb_sectors = div_round_up(image_size(), MMC_SECTOR_SIZE);
+	if (nb_sectors > STAGE2_MMC_NB_SECTORS) {
+		SERIAL_ERR(ERR_STAGE2_BAD_IMAGE);
+		return -1;
+	}
+
+	SERIAL_PUTS("MMC: Loading stage 2.\n");
+
+	/* The header was read already; the rest goes straight to its load
+	 * address, unless a sector straddles segment boundaries. */
+	offset = MMC_SECTOR_SIZE;
+	if (nb_sectors > 1) {
+		mmc_start_block(id, start + 1, nb_sectors - 1);
+
+		for (; offset < nb_sectors * MMC_SECTOR_SIZE;
+				offset += MMC_SECTOR_SIZE) {
+			void *dst = image_block_addr(offset, MMC_SECTOR_SIZE);
+
+			if (mmc_receive_block(id, dst ? dst : scratch)) {
+				err = ERR_STAGE2_IO;
+				break;
+			}
+
+			if (!dst)
+				image_scatter(offset, scratch, MMC_SECTOR_SIZE);
+		}
+
+		mmc_stop_block(id);
+	}
+
+	if (!err && image_finish(offset))
+		err = ERR_STAGE2_BAD_IMAGE;
+
+	if (err) {
+		SERIAL_ERR(err);
+		return -1;
+	}
+
+	*exec_addr = entry;
+	return 0;
+}
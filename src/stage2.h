@@ -0,0 +1,11 @@
+#ifndef STAGE2_H
+#define STAGE2_H
+
+/*
+ * Loads stage 2, an ELF or uImage file written to the raw sectors of the
+ * SD card starting at STAGE2_MMC_SECTOR, or its backup copy if 'alt' is
+ * set. Returns 0 and writes its entry point to 'exec_addr' on success.
+ */
+int mmc_load_stage2(unsigned int id, int alt, void **exec_addr);
+
+#endif
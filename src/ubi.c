@@ -7,8 +7,8 @@
  */
 
 #include <string.h>
-#include <alloca.h>
 
+#include "bench.h"
 #include "board.h"
 #include "ubi.h"
 #include "errorcodes.h"
@@ -18,15 +18,77 @@
 #include "config.h"
 #include "utils.h"
 #include "uimage.h"
+#ifdef USE_UBI_FDT
+#include "fdt.h"
+#endif
 
 #define BLOCK_SIZE (PAGE_PER_BLOCK * PAGE_SIZE)
 
-#define volume_name(id) \
-    (id ? UBI_KERNEL_BAK_VOLUME : UBI_KERNEL_VOLUME)
-#define volume_name_len(id) \
-    (id ? sizeof(UBI_KERNEL_BAK_VOLUME) : sizeof(UBI_KERNEL_VOLUME))
+/* Volumes to load, besides the layout volume; named in volume_names[] */
+enum {
+	VOL_KERNEL,
+#ifdef USE_UBI_INITRD
+	VOL_INITRD,
+#endif
+#ifdef USE_UBI_FDT
+	VOL_FDT,
+#endif
+	VOL_LAYOUT,
+	NB_TRACKED_VOLUMES,
+};
+
+/* Regular and backup set, picked by the 'alt' parameter */
+static const char * const volume_names[2][VOL_LAYOUT] = {
+#ifdef USE_STAGE2
+	/* Stage 1 loads stage 2 in place of the kernel. */
+	{ UBI_STAGE2_VOLUME, }, { UBI_STAGE2_BAK_VOLUME, },
+#else
+	{
+		UBI_KERNEL_VOLUME,
+#ifdef USE_UBI_INITRD
+		UBI_INITRD_VOLUME,
+#endif
+#ifdef USE_UBI_FDT
+		UBI_FDT_VOLUME,
+#endif
+	}, {
+		UBI_KERNEL_BAK_VOLUME,
+#ifdef USE_UBI_INITRD
+		UBI_INITRD_BAK_VOLUME,
+#endif
+#ifdef USE_UBI_FDT
+		UBI_FDT_BAK_VOLUME,
+#endif
+	},
+#endif
+};
+
+/* A PEB met before the volume table could be read */
+struct PendingPeb {
+	uint32_t peb;
+	uint32_t vol_id;
+};
 
-SLIST_HEAD(EraseBlockList, EraseBlock);
+/*
+ * LEB to PEB tables of the tracked volumes, indexed by LEB number. They live
+ * at the top of the RAM, as a volume can't have more LEBs than there are
+ * PEBs in the partition. The volume table and the pending PEBs come next.
+ */
+struct VolumeMaps {
+	struct EraseBlock *lebs[NB_TRACKED_VOLUMES];
+	unsigned int loaded[NB_TRACKED_VOLUMES];
+	uint32_t used_ebs[NB_TRACKED_VOLUMES]; /* static volumes only */
+	uint32_t vol_ids[NB_TRACKED_VOLUMES]; /* UBI_NO_VOL if not found */
+	uint32_t max_lebs;
+
+	const char * const *names;
+	int resolved; /* vol_ids were read from the volume table */
+	uint32_t layout_pebs[2]; /* where that table was read from */
+
+	struct ubi_vol_tbl_record *vtbl;
+	struct PendingPeb *pending;
+	uint32_t nb_pending;
+};
 
 static inline void *get_ptr(uint32_t eb_start, uint8_t *eb_copy, uint32_t page)
 {
@@ -37,167 +99,900 @@ static inline void *get_ptr(uint32_t eb_start, uint8_t *eb_copy, uint32_t page)
 	return (void *)eb_copy;
 }
 
-static struct EraseBlock *get_eb(struct EraseBlockList *eb_list, uint32_t leb)
+/* Forgets all the LEBs, but not the volume IDs. */
+static void clear_maps(struct VolumeMaps *maps)
 {
-	struct EraseBlock *eb;
+	unsigned int i;
 
-	SLIST_FOREACH(eb, eb_list, next) {
-		if (eb->leb == leb)
-			return eb;
+	for (i = 0; i < NB_TRACKED_VOLUMES; i++) {
+		maps->loaded[i] = 0;
+		maps->used_ebs[i] = 0;
 	}
+	maps->nb_pending = 0;
 
-	return NULL;
+	memset(maps->lebs[NB_TRACKED_VOLUMES - 1], 0xff,
+	       NB_TRACKED_VOLUMES * maps->max_lebs
+			* sizeof(struct EraseBlock));
 }
 
-static uint32_t get_kernel_vol_id(uint32_t eb, uint32_t data_page,
-				  uint32_t nb_volumes, unsigned int id)
+static void init_maps(struct VolumeMaps *maps, void *top, uint32_t nb_ebs,
+		      unsigned int alt)
 {
-	unsigned long page = eb * PAGE_PER_BLOCK + data_page;
-	struct ubi_vol_tbl_record *records;
-	unsigned int nb = div_round_up(nb_volumes * sizeof(*records),
-				       PAGE_SIZE);
 	unsigned int i;
+	size_t size = nb_ebs * sizeof(struct EraseBlock);
+
+	maps->max_lebs = nb_ebs;
+	for (i = 0; i < NB_TRACKED_VOLUMES; i++) {
+		maps->lebs[i] = top - (i + 1) * size;
+		maps->vol_ids[i] = UBI_NO_VOL;
+	}
+	maps->vol_ids[VOL_LAYOUT] = UBI_VOL_TABLE_ID;
 
-	records = alloca(PAGE_SIZE * nb);
-	nand_load(page, nb, (uint8_t *)records);
+	maps->names = volume_names[alt];
+	maps->resolved = 0;
 
-	for (i = 0; i < nb_volumes; i++) {
-		if (!records[i].name[0])
-			continue;
+	maps->vtbl = (void *)maps->lebs[NB_TRACKED_VOLUMES - 1]
+		- div_round_up(UBI_MAX_VOLUMES * sizeof(*maps->vtbl),
+			       PAGE_SIZE) * PAGE_SIZE;
+	maps->pending = (struct PendingPeb *)maps->vtbl - nb_ebs;
 
-		if (!strncmp((const char *)records[i].name,
-			     volume_name(id), volume_name_len(id))) {
-			return i;
-		}
+	clear_maps(maps);
+}
+
+static struct EraseBlock *get_eb(struct VolumeMaps *maps, int vol, uint32_t leb)
+{
+	struct EraseBlock *eb = &maps->lebs[vol][leb];
+
+	if (leb >= maps->max_lebs || eb->peb == UBI_NO_PEB)
+		return NULL;
+
+	return eb;
+}
+
+/* The header CRCs cover everything but the CRC field, which comes last. */
+#define hdr_crc_ok(hdr) \
+    (crc32(UBI_CRC32_INIT, hdr, sizeof(*(hdr)) - 4) == __bswap32((hdr)->hdr_crc))
+
+static void set_eb(struct EraseBlock *eb, uint32_t peb,
+		   const struct ubi_vid_hdr *vid_hdr)
+{
+	eb->peb = peb;
+	eb->sqnum = __bswap64(vid_hdr->sqnum);
+	eb->copy_flag = vid_hdr->copy_flag;
+	eb->in_ram = 0;
+
+	if (vid_hdr->vol_type == UBI_VID_STATIC) {
+		eb->data_size = __bswap32(vid_hdr->data_size);
+		eb->data_crc = __bswap32(vid_hdr->data_crc);
+	} else {
+		eb->data_size = 0;
 	}
+}
 
-	return (uint32_t)-1;
+/*
+ * Records a copy of a LEB, unless a newer one is already known. Without a
+ * VID header, the copy is only known from the fastmap, and anything found
+ * in its pools is newer.
+ */
+static void add_eb(struct VolumeMaps *maps, int vol, uint32_t leb,
+		   uint32_t peb, const struct ubi_vid_hdr *vid_hdr)
+{
+	struct EraseBlock *eb = &maps->lebs[vol][leb];
+
+	if (leb >= maps->max_lebs)
+		return;
+
+	if (eb->peb == UBI_NO_PEB)
+		maps->loaded[vol]++;
+	else if (!vid_hdr || __bswap64(vid_hdr->sqnum) <= eb->sqnum)
+		return;
+
+	if (vid_hdr) {
+		set_eb(eb, peb, vid_hdr);
+	} else {
+		eb->peb = peb;
+		eb->sqnum = 0;
+		eb->data_size = 0;
+		eb->in_ram = 0;
+	}
 }
 
-static int load_kernel(uint32_t eb_start, uint32_t nb_ebs, uint8_t *ld_addr,
-		       void **exec_addr, unsigned int kernel_volume)
+#ifdef BAD_BLOCK_POS
+#define peb_is_bad(peb) nand_block_is_bad(peb)
+#else
+#define peb_is_bad(peb) 0
+#endif
+
+/*
+ * Records the LEB of a tracked volume held by a PEB; returns non-zero if the
+ * PEB is marked bad. The marker costs a page read, so it is only checked for
+ * the PEBs that would be used: the others are skipped anyway.
+ */
+static int add_vid_hdr(struct VolumeMaps *maps, int vol, uint32_t peb,
+		       struct ubi_vid_hdr *vid_hdr)
+{
+	if (peb_is_bad(peb))
+		return -1;
+
+	add_eb(maps, vol, __bswap32(vid_hdr->lnum), peb, vid_hdr);
+
+	if (vid_hdr->vol_type == UBI_VID_STATIC)
+		maps->used_ebs[vol] = __bswap32(vid_hdr->used_ebs);
+
+	return 0;
+}
+
+/*
+ * Returns the VID header of the PEB, or NULL if it has no intact one. Bad PEBs
+ * are not told apart here; see add_vid_hdr().
+ */
+static struct ubi_vid_hdr *read_vid_hdr(uint32_t peb, uint32_t vid_hdr_offset,
+					uint8_t *buf)
 {
-	uint32_t i, data_page, vid_hdr_page, kernel_vol_id;
-	static uint8_t eb_copy[PAGE_SIZE];
-	struct ubi_ec_hdr *ec_hdr;
 	struct ubi_vid_hdr *vid_hdr;
-	unsigned int loaded[3] = { 0, 0, 0 };
 
-	struct EraseBlockList eb_list[3];
+	/* Only read the ECC block holding the VID header. */
+	nand_read_subpage(peb * PAGE_PER_BLOCK + vid_hdr_offset / PAGE_SIZE,
+			  (vid_hdr_offset % PAGE_SIZE) / ECC_BLOCK, buf);
+	vid_hdr = (void *)(buf + vid_hdr_offset % ECC_BLOCK);
 
-	for (i = 0; i < ARRAY_SIZE(eb_list); i++)
-		SLIST_INIT(&eb_list[i]);
+	if (vid_hdr->magic != UBI_VID_HDR_MAGIC || !hdr_crc_ok(vid_hdr))
+		return NULL;
 
-	ec_hdr = get_ptr(eb_start, eb_copy, 0);
+	return vid_hdr;
+}
 
-	if (ec_hdr->magic != UBI_EC_HDR_MAGIC) {
-		SERIAL_ERR(ERR_UBI_NO_PART);
+/*
+ * Called when the data of a LEB doesn't match its CRC. Like Linux, only falls
+ * back to the original of a copy made by wear-leveling: replaces 'eb' with
+ * the newest older copy of the LEB. Returns non-zero if there is none.
+ */
+static int find_older_copy(uint32_t eb_start, uint32_t nb_ebs,
+			   uint32_t vid_hdr_offset, uint32_t vol_id,
+			   uint32_t leb, struct EraseBlock *eb, uint8_t *buf)
+{
+	uint64_t below = eb->sqnum;
+	struct ubi_vid_hdr *vid_hdr;
+	uint32_t peb;
+
+	if (!eb->copy_flag)
 		return -1;
+
+	eb->peb = UBI_NO_PEB;
+	eb->sqnum = 0;
+
+	for (peb = eb_start; peb < eb_start + nb_ebs; peb++) {
+		uint64_t sqnum;
+
+		vid_hdr = read_vid_hdr(peb, vid_hdr_offset, buf);
+		if (!vid_hdr
+		    || __bswap32(vid_hdr->vol_id) != vol_id
+		    || __bswap32(vid_hdr->lnum) != leb)
+			continue;
+
+		sqnum = __bswap64(vid_hdr->sqnum);
+		if (sqnum < below && sqnum >= eb->sqnum && !peb_is_bad(peb))
+			set_eb(eb, peb, vid_hdr);
 	}
 
-	SERIAL_PUTS("UBI partition detected.\n");
+	return eb->peb == UBI_NO_PEB;
+}
 
-	vid_hdr_page = __bswap32(ec_hdr->vid_hdr_offset) / PAGE_SIZE;
-	data_page = __bswap32(ec_hdr->data_offset) / PAGE_SIZE;
+/* Index in the EraseBlock lists of the volumes we care about, or -1. */
+static int vol_index(struct VolumeMaps *maps, uint32_t vol_id)
+{
+	int i;
 
-	for (i = eb_start; i < (eb_start + nb_ebs); i++) {
-		uint32_t vol_id;
-		struct EraseBlock *eb;
-		uint32_t leb, peb = eb_start + i;
-		uint64_t sqnum;
+	for (i = 0; i < NB_TRACKED_VOLUMES; i++) {
+		if (maps->vol_ids[i] == vol_id && vol_id != UBI_NO_VOL)
+			return i;
+	}
+
+	return -1;
+}
+
+/* Remembers a PEB that may belong to a tracked volume. */
+static void add_pending(struct VolumeMaps *maps, uint32_t peb, uint32_t vol_id)
+{
+	if (maps->resolved || vol_id >= UBI_MAX_VOLUMES)
+		return;
+
+	maps->pending[maps->nb_pending].peb = peb;
+	maps->pending[maps->nb_pending].vol_id = vol_id;
+	maps->nb_pending++;
+}
+
+/* Adds the pending PEBs of the tracked volumes, once their IDs are known. */
+static void add_pending_vols(struct VolumeMaps *maps, uint32_t vid_hdr_offset,
+			     uint8_t *buf)
+{
+	struct ubi_vid_hdr *vid_hdr;
+	uint32_t i;
 
-		vid_hdr = get_ptr(peb, eb_copy, vid_hdr_page);
+	for (i = 0; i < maps->nb_pending; i++) {
+		struct PendingPeb *p = &maps->pending[i];
+		int vol = vol_index(maps, p->vol_id);
 
-		if (vid_hdr->magic != UBI_VID_HDR_MAGIC)
+		if (vol < 0)
 			continue;
 
-		vol_id = __bswap32(vid_hdr->vol_id);
-		switch(vol_id) {
-		case 0:
-		case 1:
-			break;
-		case UBI_VOL_TABLE_ID:
-			vol_id = 2;
+		vid_hdr = read_vid_hdr(p->peb, vid_hdr_offset, buf);
+		if (vid_hdr)
+			add_vid_hdr(maps, vol, p->peb, vid_hdr);
+	}
+
+	maps->nb_pending = 0;
+}
+
+/* Reads a copy of the volume table; returns non-zero if it is corrupted. */
+static int read_vtbl(struct ubi_vol_tbl_record *vtbl, uint32_t peb,
+		     uint32_t data_page, unsigned int nb_records)
+{
+	unsigned int i;
+
+	nand_load(peb * PAGE_PER_BLOCK + data_page,
+		  div_round_up(nb_records * sizeof(*vtbl), PAGE_SIZE),
+		  (uint8_t *)vtbl);
+
+	/* Empty records carry a CRC too. */
+	for (i = 0; i < nb_records; i++) {
+		if (crc32(UBI_CRC32_INIT, &vtbl[i], sizeof(*vtbl) - 4)
+				!= __bswap32(vtbl[i].crc))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Looks up the IDs of the volumes to load in the volume table. Both copies of
+ * the layout volume hold the same table; the second one is only used if the
+ * first one is missing or corrupted. Returns non-zero if neither is usable.
+ */
+static int resolve_volumes(struct VolumeMaps *maps, uint32_t data_page,
+			   uint32_t leb_size)
+{
+	unsigned int nb_records = leb_size / sizeof(*maps->vtbl);
+	unsigned int i, leb, vol;
+	struct EraseBlock *eb;
+
+	if (nb_records > UBI_MAX_VOLUMES)
+		nb_records = UBI_MAX_VOLUMES;
+
+	for (leb = 0; leb < 2; leb++) {
+		eb = get_eb(maps, VOL_LAYOUT, leb);
+		maps->layout_pebs[leb] = eb ? eb->peb : UBI_NO_PEB;
+	}
+
+	for (leb = 0; leb < 2; leb++) {
+		if (maps->layout_pebs[leb] != UBI_NO_PEB
+		    && !read_vtbl(maps->vtbl, maps->layout_pebs[leb],
+				  data_page, nb_records))
 			break;
-		default:
-			continue;
+	}
+	if (leb == 2)
+		return -1;
+
+	for (vol = 0; vol < VOL_LAYOUT; vol++) {
+		const char *name = maps->names[vol];
+
+		maps->vol_ids[vol] = UBI_NO_VOL;
+
+		/* Volumes being updated are incomplete. */
+		for (i = 0; i < nb_records; i++) {
+			if (!maps->vtbl[i].upd_marker
+			    && !strncmp((const char *)maps->vtbl[i].name,
+					name, strlen(name) + 1))
+				maps->vol_ids[vol] = i;
 		}
+	}
 
-		leb = __bswap32(vid_hdr->lnum);
-		sqnum = __bswap64(vid_hdr->sqnum);
+	maps->resolved = 1;
+	return 0;
+}
+
+/* Whether the layout volume changed since the volume table was read */
+static int layout_changed(struct VolumeMaps *maps)
+{
+	unsigned int leb;
 
-		eb = get_eb(&eb_list[vol_id], leb);
-		if (eb) {
-			/* EB is already in the list. Use the sqnum
-			 * field to find the newest */
+	for (leb = 0; leb < 2; leb++) {
+		struct EraseBlock *eb = get_eb(maps, VOL_LAYOUT, leb);
 
-			if (sqnum > eb->sqnum) {
-				eb->peb = peb;
-				eb->sqnum = sqnum;
-			}
+		if ((eb ? eb->peb : UBI_NO_PEB) != maps->layout_pebs[leb])
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Whether all the tracked volumes are static and have all their LEBs */
+static int volumes_complete(struct VolumeMaps *maps)
+{
+	unsigned int vol;
+
+	for (vol = 0; vol < VOL_LAYOUT; vol++) {
+		if (maps->vol_ids[vol] != UBI_NO_VOL
+		    && (!maps->used_ebs[vol]
+			|| maps->loaded[vol] != maps->used_ebs[vol]))
+			return 0;
+	}
+
+	return 1;
+}
 
+#if (PAGE_SIZE != 512)
+/*
+ * Cheap check for the PEBs left to scan once the tracked volumes are
+ * complete: peeks at the VID header, without ECC. Returns 0 if the PEB is
+ * erased, or holds an intact header of a volume that is not tracked.
+ */
+static int may_hold_tracked_vol(struct VolumeMaps *maps, uint32_t peb,
+				uint32_t vid_hdr_offset)
+{
+	uint32_t raw[sizeof(struct ubi_vid_hdr) / 4];
+	struct ubi_vid_hdr *vid_hdr = (void *)raw;
+	uint32_t erased = 0xffffffff;
+	unsigned int i;
+
+	nand_read_raw(peb * PAGE_PER_BLOCK + vid_hdr_offset / PAGE_SIZE,
+		      vid_hdr_offset % PAGE_SIZE, (uint8_t *)raw, sizeof(raw));
+
+	for (i = 0; i < ARRAY_SIZE(raw); i++)
+		erased &= raw[i];
+	if (erased == 0xffffffff)
+		return 0;
+
+	/* Bit flips are not corrected here: a header that fails its CRC may
+	 * still be one of ours, and gets read with ECC. */
+	if (vid_hdr->magic != UBI_VID_HDR_MAGIC || !hdr_crc_ok(vid_hdr))
+		return 1;
+
+	return vol_index(maps, __bswap32(vid_hdr->vol_id)) >= 0;
+}
+#endif
+
+#ifdef USE_UBI_FASTMAP
+/*
+ * Walks the volume headers and EBA tables of the fastmap, adding the LEBs of
+ * the tracked volumes. Returns non-zero if they run past 'size' bytes.
+ */
+static int fastmap_add_ebas(struct VolumeMaps *maps, uint8_t *buf,
+			    uint32_t size, uint32_t vol_count,
+			    uint32_t eb_start)
+{
+	uint32_t i, j, offset = 0;
+
+	for (i = 0; i < vol_count; i++) {
+		struct ubi_fm_volhdr *volhdr;
+		struct ubi_fm_eba *eba;
+		uint32_t nb_lebs;
+		int vol;
+
+		volhdr = (struct ubi_fm_volhdr *)(buf + offset);
+		eba = (struct ubi_fm_eba *)(volhdr + 1);
+		if (offset + sizeof(*volhdr) + sizeof(*eba) > size
+		    || __bswap32(volhdr->magic) != UBI_FM_VHDR_MAGIC
+		    || __bswap32(eba->magic) != UBI_FM_EBA_MAGIC)
+			return -1;
+
+		nb_lebs = __bswap32(eba->reserved_pebs);
+		offset += sizeof(*volhdr) + sizeof(*eba) + nb_lebs * 4;
+		if (offset > size)
+			return -1;
+
+		vol = vol_index(maps, __bswap32(volhdr->vol_id));
+		if (vol < 0)
 			continue;
+
+		for (j = 0; j < nb_lebs; j++) {
+			uint32_t pnum = __bswap32(eba->pnum[j]);
+
+			if (pnum != (uint32_t)-1)
+				add_eb(maps, vol, j, eb_start + pnum, NULL);
 		}
+	}
 
-		eb = alloca(sizeof(*eb));
-		eb->peb = peb;
-		eb->leb = leb;
-		eb->sqnum = sqnum;
-		eb->vol_id = vol_id;
-		SLIST_INSERT_HEAD(&eb_list[vol_id], eb, next);
-		loaded[vol_id]++;
+	return 0;
+}
+
+/*
+ * Fills the LEB tables from the fastmap written by Linux, instead of reading
+ * the VID header of every PEB. The fastmap is read below the tables.
+ * Returns non-zero if there is no usable fastmap; the tables must then be
+ * rebuilt by a full scan.
+ */
+static int fastmap_attach(uint32_t eb_start, uint32_t nb_ebs,
+			  uint32_t vid_hdr_offset, uint32_t data_page,
+			  struct VolumeMaps *maps, uint8_t *buf)
+{
+	uint32_t leb_size = (PAGE_PER_BLOCK - data_page) * PAGE_SIZE;
+	uint32_t i, j, anchor = (uint32_t)-1, used_blocks, fm_size, offset, crc;
+	struct ubi_vid_hdr *vid_hdr;
+	struct ubi_fm_scan_pool *pool;
+	struct ubi_fm_hdr *fmhdr;
+	struct ubi_fm_sb *fmsb;
+	uint64_t sqnum = 0;
+	uint8_t *fm;
+
+	/* Find the newest anchor. */
+	for (i = 0; i < UBI_FM_MAX_START && i < nb_ebs; i++) {
+		vid_hdr = read_vid_hdr(eb_start + i, vid_hdr_offset, buf);
+		if (!vid_hdr
+		    || __bswap32(vid_hdr->vol_id) != UBI_FM_SB_VOLUME_ID
+		    || __bswap64(vid_hdr->sqnum) < sqnum
+		    || peb_is_bad(eb_start + i))
+			continue;
+
+		anchor = eb_start + i;
+		sqnum = __bswap64(vid_hdr->sqnum);
 	}
 
-	if (loaded[2] == 0) {
-		SERIAL_ERR(ERR_UBI_IO);
+	if (anchor == (uint32_t)-1)
+		return -1;
+
+	fm = (uint8_t *)maps->pending - UBI_FM_MAX_BLOCKS * BLOCK_SIZE;
+	fmsb = (struct ubi_fm_sb *)fm;
+
+	nand_load(anchor * PAGE_PER_BLOCK + data_page,
+		  PAGE_PER_BLOCK - data_page, fm);
+
+	used_blocks = __bswap32(fmsb->used_blocks);
+	if (__bswap32(fmsb->magic) != UBI_FM_SB_MAGIC
+	    || fmsb->version != UBI_FM_FMT_VERSION
+	    || !used_blocks || used_blocks > UBI_FM_MAX_BLOCKS)
 		return -1;
+
+	for (i = 1; i < used_blocks; i++) {
+		uint32_t peb = eb_start + __bswap32(fmsb->block_loc[i]);
+
+		vid_hdr = read_vid_hdr(peb, vid_hdr_offset, buf);
+		if (!vid_hdr
+		    || __bswap32(vid_hdr->vol_id) != UBI_FM_DATA_VOLUME_ID
+		    || peb_is_bad(peb))
+			return -1;
+
+		nand_load(peb * PAGE_PER_BLOCK + data_page,
+			  PAGE_PER_BLOCK - data_page, fm + i * leb_size);
 	}
 
-	kernel_vol_id = get_kernel_vol_id(SLIST_FIRST(&eb_list[2])->peb,
-					  data_page, 8, kernel_volume);
-	if (kernel_vol_id >= UBI_VOL_TABLE_ID) {
-               SERIAL_ERR(ERR_UBI_NO_KERNEL);
-			   return -1;
+	fm_size = used_blocks * leb_size;
+	crc = __bswap32(fmsb->data_crc);
+	fmsb->data_crc = 0;
+	if (crc32(UBI_CRC32_INIT, fm, fm_size) != crc)
+		return -1;
+
+	offset = sizeof(*fmsb);
+	fmhdr = (struct ubi_fm_hdr *)(fm + offset);
+	if (__bswap32(fmhdr->magic) != UBI_FM_HDR_MAGIC)
+		return -1;
+
+	/* The pools come next; skip them for now. */
+	offset += sizeof(*fmhdr) + 2 * sizeof(*pool);
+
+	/* Skip the free, used, scrub and erase PEB lists. */
+	offset += (__bswap32(fmhdr->free_peb_count)
+		   + __bswap32(fmhdr->used_peb_count)
+		   + __bswap32(fmhdr->scrub_peb_count)
+		   + __bswap32(fmhdr->erase_peb_count))
+		* sizeof(struct ubi_fm_ec);
+
+	/* Only the layout volume is known yet. */
+	if (fastmap_add_ebas(maps, fm + offset, fm_size - offset,
+			     __bswap32(fmhdr->vol_count), eb_start))
+		return -1;
+
+	/* PEBs of the pools may have been written since the fastmap. */
+	pool = (struct ubi_fm_scan_pool *)(fmhdr + 1);
+	for (i = 0; i < 2; i++, pool++) {
+		uint32_t pool_size = __bswap16(pool->size);
+
+		if (__bswap32(pool->magic) != UBI_FM_POOL_MAGIC
+		    || pool_size > UBI_FM_MAX_POOL_SIZE)
+			return -1;
+
+		for (j = 0; j < pool_size; j++) {
+			uint32_t peb = eb_start + __bswap32(pool->pebs[j]);
+			int vol;
+
+			vid_hdr = read_vid_hdr(peb, vid_hdr_offset, buf);
+			if (!vid_hdr)
+				continue;
+
+			vol = vol_index(maps, __bswap32(vid_hdr->vol_id));
+			if (vol >= 0)
+				add_vid_hdr(maps, vol, peb, vid_hdr);
+			else
+				add_pending(maps, peb,
+					    __bswap32(vid_hdr->vol_id));
+		}
 	}
 
-	SERIAL_PUTS("Requested volume ");
-	SERIAL_PUTS(volume_name(kernel_volume));
-	SERIAL_PUTS_ARGI(" was found at ID ", kernel_vol_id, ".\n");
+	if (resolve_volumes(maps, data_page, leb_size))
+		return -1;
 
-	for (i = 0; i < loaded[kernel_vol_id]; i++) {
-		unsigned int page_addr, nb_pages = PAGE_PER_BLOCK - data_page;
-		struct EraseBlock *eb = get_eb(&eb_list[kernel_vol_id], i);
+	add_pending_vols(maps, vid_hdr_offset, buf);
+	fastmap_add_ebas(maps, fm + offset, fm_size - offset,
+			 __bswap32(fmhdr->vol_count), eb_start);
+
+	/* A fastmap left behind by a kernel attaching without fastmap
+	 * support would be stale: make sure that the PEBs still hold the
+	 * LEBs it says they do. Their VID headers also tell the sqnum and
+	 * the data CRC. */
+	for (i = 0; i < NB_TRACKED_VOLUMES; i++) {
+		for (j = 0; j < maps->max_lebs; j++) {
+			struct EraseBlock *eb = get_eb(maps, i, j);
+
+			if (!eb || eb->sqnum)
+				continue;
+
+			vid_hdr = read_vid_hdr(eb->peb, vid_hdr_offset, buf);
+			if (!vid_hdr
+			    || vol_index(maps, __bswap32(vid_hdr->vol_id))
+					!= (int)i
+			    || __bswap32(vid_hdr->lnum) != j
+			    || add_vid_hdr(maps, i, eb->peb, vid_hdr))
+				return -1;
+		}
+	}
 
-		if (!eb) {
-			SERIAL_ERR(ERR_UBI_IO);
+	SERIAL_PUTS("UBI fastmap attached.\n");
+	return 0;
+}
+#endif /* USE_UBI_FASTMAP */
+
+/*
+ * Loads a LEB of a tracked volume to its offset in 'dst', or through the
+ * segment router if 'dst' is NULL, for the kernel image; LEB 0 must then be
+ * loaded first, as it holds the image header. Returns -1 if the header is
+ * rejected, or 1 if the data of a static volume doesn't match its CRC.
+ */
+static int load_leb(struct VolumeMaps *maps, int vol, uint32_t leb,
+		    uint8_t *dst, void **exec_addr, uint32_t data_page,
+		    uint8_t *eb_copy)
+{
+	struct EraseBlock *eb = &maps->lebs[vol][leb];
+	uint32_t leb_size = (PAGE_PER_BLOCK - data_page) * PAGE_SIZE;
+	uint32_t offset = leb * leb_size, data_size, image_end;
+	unsigned int page_addr, nb_pages;
+	uint8_t *blk;
+
+	image_end = dst || !leb ? (uint32_t)-1 : image_size();
+
+	/* Only read the pages that hold data. The whole data of static
+	 * volumes is read though, for its CRC to be checked. */
+	data_size = eb->data_size ? eb->data_size : leb_size;
+	if (!eb->data_size && data_size > image_end - offset)
+		data_size = image_end - offset;
+
+	nb_pages = div_round_up(data_size, PAGE_SIZE);
+	page_addr = eb->peb * PAGE_PER_BLOCK + data_page;
+
+	if (eb->data_size)
+		nand_crc_start(UBI_CRC32_INIT, eb->data_size);
+
+	if (dst) {
+		nand_load(page_addr, nb_pages, dst + offset);
+		goto check_crc;
+	}
+
+	if (leb == 0) {
+		/* Read the page holding the image header out of band; the rest
+		 * of the image then goes straight to its load address. */
+		nand_read_page(page_addr, eb_copy);
+
+		if (process_image_header(eb_copy, exec_addr, PAGE_SIZE)) {
+			nand_crc_end();
 			return -1;
 		}
 
-		page_addr = eb->peb * PAGE_PER_BLOCK + data_page;
+		image_end = image_size();
+		if (!eb->data_size
+		    && nb_pages > div_round_up(image_end, PAGE_SIZE))
+			nb_pages = div_round_up(image_end, PAGE_SIZE);
 
-		if (i == 0) {
-			nand_read_page(page_addr, ld_addr);
+		nb_pages--;
+		page_addr++;
+		offset += PAGE_SIZE;
+	}
+
+	blk = image_block_addr(offset, nb_pages * PAGE_SIZE);
+	if (blk) {
+		nand_load(page_addr, nb_pages, blk);
+	} else {
+		/* This LEB straddles segment boundaries. */
+		for (; nb_pages; nb_pages--, page_addr++, offset += PAGE_SIZE) {
+			blk = image_block_addr(offset, PAGE_SIZE);
+			nand_read_page(page_addr, blk ? blk : eb_copy);
+			if (!blk)
+				image_scatter(offset, eb_copy, PAGE_SIZE);
+		}
+	}
+
+check_crc:
+	if (eb->data_size && nand_crc_end() != eb->data_crc)
+		return 1;
 
-			ld_addr = process_uimage_header((void *)ld_addr,
-					exec_addr, PAGE_SIZE);
-			if (!ld_addr) {
+	eb->in_ram = 1;
+	return 0;
+}
+
+/*
+ * Loads a LEB of the kernel volume as soon as the scan meets it, instead of
+ * coming back for it once the scan is over. This needs the image header, so
+ * only starts once LEB 0 is in; a newer copy of the latter voids everything
+ * loaded so far, as the image layout may have changed.
+ */
+static void load_ahead(struct VolumeMaps *maps, uint32_t leb, uint32_t peb,
+		       void **exec_addr, uint32_t data_page, uint8_t *eb_copy)
+{
+	struct EraseBlock *eb = get_eb(maps, VOL_KERNEL, leb);
+	struct EraseBlock *first = get_eb(maps, VOL_KERNEL, 0);
+	uint32_t i;
+
+	/* Not the newest copy */
+	if (!eb || eb->peb != peb)
+		return;
+
+	if (leb == 0) {
+		for (i = 1; i < maps->max_lebs; i++)
+			maps->lebs[VOL_KERNEL][i].in_ram = 0;
+	} else if (!first || !first->in_ram) {
+		return;
+	}
+
+	/* Failures are dealt with, and reported, by load_volume(). */
+	load_leb(maps, VOL_KERNEL, leb, NULL, exec_addr, data_page, eb_copy);
+}
+
+/*
+ * Loads the LEBs of a tracked volume that are not in RAM yet; see
+ * load_leb(). LEBs with a bad data CRC are loaded again from an older copy,
+ * if there is one.
+ */
+static int load_volume(struct VolumeMaps *maps, int vol, uint8_t *dst,
+		       void **exec_addr, uint32_t eb_start, uint32_t nb_ebs,
+		       uint32_t vid_hdr_offset, uint32_t data_page,
+		       uint8_t *eb_copy)
+{
+	uint32_t leb_size = (PAGE_PER_BLOCK - data_page) * PAGE_SIZE;
+	uint32_t i, offset = 0, image_end = (uint32_t)-1;
+	struct EraseBlock *eb;
+	int err;
+
+	for (i = 0; i < maps->loaded[vol] && offset < image_end; i++) {
+		eb = get_eb(maps, vol, i);
+		if (!eb) {
+			SERIAL_ERR(ERR_UBI_IO);
+			return -1;
+		}
+
+		while (!eb->in_ram) {
+			err = load_leb(maps, vol, i, dst, exec_addr, data_page,
+				       eb_copy);
+			if (err < 0) {
 				SERIAL_ERR(ERR_FAT_BAD_IMAGE);
 				return -1;
 			}
 
-			nb_pages--;
-			page_addr++;
+			if (err) {
+				SERIAL_PUTS_ARGI("Bad data CRC in LEB ", i,
+						 ".\n");
+
+				if (find_older_copy(eb_start, nb_ebs,
+						    vid_hdr_offset,
+						    maps->vol_ids[vol], i, eb,
+						    eb_copy)) {
+					SERIAL_ERR(ERR_UBI_BAD_CRC);
+					return -1;
+				}
+			}
 		}
 
-		nand_load(page_addr, nb_pages, ld_addr);
-		ld_addr += nb_pages * PAGE_SIZE;
+		if (i == 0 && !dst)
+			image_end = image_size();
+
+		offset = i * leb_size
+			+ (eb->data_size ? eb->data_size : leb_size);
+	}
+
+	if (!dst && image_finish(offset)) {
+		SERIAL_ERR(ERR_FAT_BAD_IMAGE);
+		return -1;
 	}
 
 	return 0;
 }
 
-int ubi_load_kernel(unsigned char *ld_addr, void **exec_addr, uint32_t vol_id)
+#if defined(USE_UBI_INITRD) || defined(USE_UBI_FDT)
+/* Size of the data of a volume; only exact for static volumes. */
+static uint32_t volume_size(struct VolumeMaps *maps, int vol,
+			    uint32_t leb_size)
+{
+	uint32_t nb = maps->loaded[vol];
+	struct EraseBlock *eb = get_eb(maps, vol, nb - 1);
+
+	return (nb - 1) * leb_size
+		+ (eb && eb->data_size ? eb->data_size : leb_size);
+}
+
+/* Returns where to load 'size' bytes right below 'top', plus 'room' bytes. */
+static void *place_volume(void *top, uint32_t size, uint32_t room)
+{
+	size = div_round_up(size, PAGE_SIZE) * PAGE_SIZE;
+
+	return (void *)(((uint32_t)top - size - room) & ~0xfff);
+}
+#endif
+
+static int load_kernel(uint32_t eb_start, uint32_t nb_ebs,
+		       void **exec_addr, unsigned int alt)
+{
+	uint32_t i, peb, data_page, vid_hdr_offset, leb_size, scan_end;
+	static uint8_t eb_copy[PAGE_SIZE] __attribute__((aligned(4)));
+	struct ubi_ec_hdr *ec_hdr;
+	struct ubi_vid_hdr *vid_hdr;
+	unsigned int mem_size = get_memory_size();
+	struct VolumeMaps maps;
+	void *ram_top;
+#if defined(USE_UBI_INITRD) || defined(USE_UBI_FDT)
+	void *top;
+#endif
+
+	/* The tables, and what gets placed below them, must stay in reach
+	 * of kseg0/kseg1. */
+	ram_top = (void *)(LOAD_SEG + (mem_size > LOWMEM_SIZE ?
+				       LOWMEM_SIZE : mem_size));
+
+	ec_hdr = get_ptr(eb_start, eb_copy, 0);
+
+	if (ec_hdr->magic != UBI_EC_HDR_MAGIC) {
+		SERIAL_ERR(ERR_UBI_NO_PART);
+		return -1;
+	}
+
+	SERIAL_PUTS("UBI partition detected.\n");
+
+	/* Take the offsets from the first intact EC header. */
+	for (peb = eb_start + 1; ec_hdr->magic != UBI_EC_HDR_MAGIC
+			|| !hdr_crc_ok(ec_hdr); peb++) {
+		if (peb == eb_start + nb_ebs) {
+			SERIAL_ERR(ERR_UBI_IO);
+			return -1;
+		}
+
+		ec_hdr = get_ptr(peb, eb_copy, 0);
+	}
+
+	vid_hdr_offset = __bswap32(ec_hdr->vid_hdr_offset);
+	data_page = __bswap32(ec_hdr->data_offset) / PAGE_SIZE;
+	leb_size = (PAGE_PER_BLOCK - data_page) * PAGE_SIZE;
+
+	init_maps(&maps, ram_top, nb_ebs, alt);
+	scan_end = eb_start + nb_ebs;
+
+#ifdef USE_UBI_FASTMAP
+	if (!fastmap_attach(eb_start, nb_ebs, vid_hdr_offset, data_page,
+			    &maps, eb_copy))
+		scan_end = eb_start;
+	else
+		init_maps(&maps, ram_top, nb_ebs, alt);
+#endif
+
+rescan:
+	for (peb = eb_start; peb < scan_end; peb++) {
+		uint32_t vol_id;
+		int vol;
+
+#if (PAGE_SIZE != 512)
+		/* Once the static volumes to load are complete, only a newer
+		 * copy of one of their LEBs could change what gets loaded;
+		 * skip the PEBs that can't hold one. */
+		if (maps.resolved && volumes_complete(&maps)
+		    && !may_hold_tracked_vol(&maps, peb, vid_hdr_offset))
+			continue;
+#endif
+
+		vid_hdr = read_vid_hdr(peb, vid_hdr_offset, eb_copy);
+		if (!vid_hdr)
+			continue;
+
+		vol_id = __bswap32(vid_hdr->vol_id);
+		vol = vol_index(&maps, vol_id);
+		if (vol < 0) {
+			/* Until the volume table is read, any volume might
+			 * be one we want. */
+			add_pending(&maps, peb, vol_id);
+			continue;
+		}
+
+		add_vid_hdr(&maps, vol, peb, vid_hdr);
+
+		if (vol == VOL_KERNEL)
+			load_ahead(&maps, __bswap32(vid_hdr->lnum), peb,
+				   exec_addr, data_page, eb_copy);
+
+		if (vol == VOL_LAYOUT && !maps.resolved
+		    && !resolve_volumes(&maps, data_page, leb_size))
+			add_pending_vols(&maps, vid_hdr_offset, eb_copy);
+	}
+
+	if (!maps.resolved) {
+		SERIAL_ERR(ERR_UBI_NO_KERNEL);
+		return -1;
+	}
+
+	/* The layout volume may have been rewritten further on. */
+	if (layout_changed(&maps)) {
+		uint32_t vol_ids[VOL_LAYOUT];
+
+		memcpy(vol_ids, maps.vol_ids, sizeof(vol_ids));
+		if (resolve_volumes(&maps, data_page, leb_size)) {
+			SERIAL_ERR(ERR_UBI_NO_KERNEL);
+			return -1;
+		}
+
+		/* The LEBs collected so far may belong to other volumes
+		 * than the ones we want: start over, now that their IDs
+		 * are known for sure. */
+		for (i = 0; i < VOL_LAYOUT; i++) {
+			if (vol_ids[i] != maps.vol_ids[i]) {
+				clear_maps(&maps);
+				scan_end = eb_start + nb_ebs;
+				goto rescan;
+			}
+		}
+	}
+
+	if (maps.vol_ids[VOL_KERNEL] == UBI_NO_VOL) {
+		SERIAL_ERR(ERR_UBI_NO_KERNEL);
+		return -1;
+	}
+
+	SERIAL_PUTS("Requested volume ");
+	SERIAL_PUTS(maps.names[VOL_KERNEL]);
+	SERIAL_PUTS_ARGI(" was found at ID ", maps.vol_ids[VOL_KERNEL], ".\n");
+	bench_mark(BENCH_UBI_SCAN);
+
+	/* The other volumes go right below the pending PEBs; the fastmap
+	 * further down isn't needed anymore. */
+#if defined(USE_UBI_INITRD) || defined(USE_UBI_FDT)
+	top = maps.pending;
+#endif
+
+#ifdef USE_UBI_INITRD
+	if (maps.vol_ids[VOL_INITRD] != UBI_NO_VOL && maps.loaded[VOL_INITRD]) {
+		boot_initrd_size = volume_size(&maps, VOL_INITRD, leb_size);
+		boot_initrd = top = place_volume(top, boot_initrd_size, 0);
+
+		if (overlaps_loader(top, boot_initrd_size)
+		    || load_volume(&maps, VOL_INITRD, boot_initrd, NULL,
+				eb_start, nb_ebs, vid_hdr_offset, data_page,
+				eb_copy))
+			return -1;
+	}
+#endif
+
+#ifdef USE_UBI_FDT
+	if (maps.vol_ids[VOL_FDT] != UBI_NO_VOL && maps.loaded[VOL_FDT]) {
+		uint32_t size = volume_size(&maps, VOL_FDT, leb_size);
+
+		top = place_volume(top, size, FDT_BOOTARGS_ROOM);
+
+		if (overlaps_loader(top, size + FDT_BOOTARGS_ROOM)
+		    || load_volume(&maps, VOL_FDT, top, NULL, eb_start, nb_ebs,
+				vid_hdr_offset, data_page, eb_copy))
+			return -1;
+
+		boot_fdt = top;
+	}
+#endif
+
+	return load_volume(&maps, VOL_KERNEL, NULL, exec_addr, eb_start,
+			   nb_ebs, vid_hdr_offset, data_page, eb_copy);
+}
+
+int ubi_load_kernel(void **exec_addr, uint32_t alt)
 {
-	return load_kernel(UBI_MTD_EB_START, UBI_MTD_NB_EB,
-			   ld_addr, exec_addr, vol_id);
+	return load_kernel(UBI_MTD_EB_START, UBI_MTD_NB_EB, exec_addr, alt);
 }
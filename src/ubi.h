@@ -3,13 +3,24 @@
 #define UBI_H
 
 #include <stdint.h>
-#include <sys/queue.h>
 #include <arpa/inet.h>
 
 #define UBI_EC_HDR_MAGIC	__bswap32(0x55424923)
 #define UBI_VID_HDR_MAGIC	__bswap32(0x55424921)
 
+
 #define UBI_VOL_TABLE_ID	0x7fffefff
+#define UBI_FM_SB_VOLUME_ID	0x7ffff000
+#define UBI_FM_DATA_VOLUME_ID	0x7ffff001
+
+#define UBI_CRC32_INIT		0xffffffff
+
+/* Volume types, as found in the VID headers */
+#define UBI_VID_DYNAMIC		1
+#define UBI_VID_STATIC		2
+
+/* The maximum number of volumes, i.e. of volume table records */
+#define UBI_MAX_VOLUMES		128
 
 /* The maximum volume name length */
 #define UBI_VOL_NAME_MAX 127
@@ -50,22 +61,106 @@ struct ubi_vol_tbl_record {
 	uint32_t alignment;
 	uint32_t data_pad;
 	uint8_t vol_type;
-	uint8_t padding1;
+	uint8_t upd_marker;
 	uint16_t name_len;
 	uint8_t name[UBI_VOL_NAME_MAX + 1];
 	uint8_t padding2[24];
 	uint32_t crc;
 } __attribute__ ((packed));
 
-struct EraseBlock {
-	uint32_t peb;
-	uint32_t leb;
+#ifdef USE_UBI_FASTMAP
+#define UBI_FM_SB_MAGIC		0x7b11d69f
+#define UBI_FM_HDR_MAGIC	0xd4b82ef7
+#define UBI_FM_POOL_MAGIC	0x67af4d08
+#define UBI_FM_VHDR_MAGIC	0xfa370ed1
+#define UBI_FM_EBA_MAGIC	0xf0c040a8
+
+#define UBI_FM_FMT_VERSION	1
+
+/* The fastmap anchor is always in one of the first 64 PEBs. */
+#define UBI_FM_MAX_START	64
+#define UBI_FM_MAX_BLOCKS	32
+#define UBI_FM_MAX_POOL_SIZE	256
+
+struct ubi_fm_sb {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t padding1[3];
+	uint32_t data_crc;
+	uint32_t used_blocks;
+	uint32_t block_loc[UBI_FM_MAX_BLOCKS];
+	uint32_t block_ec[UBI_FM_MAX_BLOCKS];
 	uint64_t sqnum;
+	uint8_t padding2[32];
+} __attribute__ ((packed));
+
+struct ubi_fm_hdr {
+	uint32_t magic;
+	uint32_t free_peb_count;
+	uint32_t used_peb_count;
+	uint32_t scrub_peb_count;
+	uint32_t bad_peb_count;
+	uint32_t erase_peb_count;
+	uint32_t vol_count;
+	uint8_t padding[4];
+} __attribute__ ((packed));
+
+struct ubi_fm_scan_pool {
+	uint32_t magic;
+	uint16_t size;
+	uint16_t max_size;
+	uint32_t pebs[UBI_FM_MAX_POOL_SIZE];
+	uint32_t padding[4];
+} __attribute__ ((packed));
+
+struct ubi_fm_ec {
+	uint32_t pnum;
+	uint32_t ec;
+} __attribute__ ((packed));
+
+struct ubi_fm_volhdr {
+	uint32_t magic;
 	uint32_t vol_id;
-	SLIST_ENTRY(EraseBlock) next;
+	uint8_t vol_type;
+	uint8_t padding1[3];
+	uint32_t data_pad;
+	uint32_t used_ebs;
+	uint32_t last_eb_bytes;
+	uint8_t padding2[8];
+} __attribute__ ((packed));
+
+struct ubi_fm_eba {
+	uint32_t magic;
+	uint32_t reserved_pebs;
+	uint32_t pnum[0];
+} __attribute__ ((packed));
+#endif /* USE_UBI_FASTMAP */
+
+/*
+ * Where the newest copy of a LEB is; peb is UBI_NO_PEB if unmapped. data_size
+ * is the number of bytes used in the LEB, or 0 if unknown (dynamic volumes);
+ * data_crc covers these bytes. copy_flag is set if wear-leveling copied the
+ * LEB there, in which case the original copy may still be around. in_ram is
+ * set once the data of this copy has been loaded.
+ */
+struct EraseBlock {
+	uint64_t sqnum;
+	uint32_t peb;
+	uint32_t data_size;
+	uint32_t data_crc;
+	uint8_t copy_flag;
+	uint8_t in_ram;
 };
 
-int ubi_load_kernel(unsigned char *ld_addr, void **exec_addr, uint32_t vol_id);
+#define UBI_NO_PEB	0xffffffff
+#define UBI_NO_VOL	0xffffffff
+
+/*
+ * Loads the kernel volume, plus the initramfs and device tree volumes if
+ * enabled, to boot_initrd and boot_fdt. With 'alt' set, the backup volumes
+ * are loaded instead.
+ */
+int ubi_load_kernel(void **exec_addr, uint32_t alt);
 
 #endif /* UBI_H */
 
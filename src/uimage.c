@@ -2,9 +2,16 @@
  * uImage: U-Boot image format
  *
  * http://www.denx.de/wiki/U-Boot/
+ *
+ * ELF: Executable and Linkable Format, as used for a raw vmlinux
  */
 
+#include "config.h"
+#include "errorcodes.h"
+#include "fdt.h"
+#include "fit.h"
 #include "jz.h"
+#include "serial.h"
 #include "uimage.h"
 #include "utils.h"
 
@@ -18,6 +25,26 @@
 
 #define UIMAGE_COMP_NONE		0	/*  No compression */
 
+#define ELF_MAGIC		0x464c457f	/* "\177ELF" */
+#define ELF_CLASS_32		1
+#define ELF_DATA_LSB		1
+#define ELF_TYPE_EXEC		2
+#define ELF_MACHINE_MIPS	8
+#define ELF_PT_LOAD		1
+
+/* Maximum number of PT_LOAD segments; vmlinux usually has only one. A FIT
+ * image uses one for its tree and one per component. */
+#define IMAGE_MAX_SEGMENTS	4
+
+void *boot_fdt;
+void *boot_initrd;
+uint32_t boot_initrd_size;
+
+#ifdef USE_CACHED_LOAD
+void *boot_kernel;
+uint32_t boot_kernel_size;
+#endif
+
 struct uimage_header {
 	/* Note: All fields are big endian. */
 	uint32_t	magic;				/* Magic number (UIMAGE_MAGIC) */
@@ -34,6 +61,94 @@ struct uimage_header {
 	uint8_t		name[32];			/* Image name */
 };
 
+struct elf32_ehdr {
+	uint32_t	e_magic;			/* Magic number (ELF_MAGIC) */
+	uint8_t		e_class;			/* Word size */
+	uint8_t		e_data;				/* Byte order */
+	uint8_t		e_ident[10];		/* Rest of the identification */
+	uint16_t	e_type;				/* Object file type */
+	uint16_t	e_machine;			/* Architecture */
+	uint32_t	e_version;			/* Object file version */
+	uint32_t	e_entry;			/* Entry point address */
+	uint32_t	e_phoff;			/* Program headers offset */
+	uint32_t	e_shoff;			/* Section headers offset */
+	uint32_t	e_flags;			/* Processor-specific flags */
+	uint16_t	e_ehsize;			/* ELF header size */
+	uint16_t	e_phentsize;		/* Program header size */
+	uint16_t	e_phnum;			/* Number of program headers */
+	uint16_t	e_shentsize;		/* Section header size */
+	uint16_t	e_shnum;			/* Number of section headers */
+	uint16_t	e_shstrndx;			/* Section name strings index */
+};
+
+struct elf32_phdr {
+	uint32_t	p_type;				/* Segment type */
+	uint32_t	p_offset;			/* Offset in the file */
+	uint32_t	p_vaddr;			/* Virtual address */
+	uint32_t	p_paddr;			/* Physical address */
+	uint32_t	p_filesz;			/* Size in the file */
+	uint32_t	p_memsz;			/* Size in memory */
+	uint32_t	p_flags;			/* Segment flags */
+	uint32_t	p_align;			/* Segment alignment */
+};
+
+/* Part of the image file that must end up in memory at 'dst'. */
+struct image_segment {
+	uint32_t	offset;
+	uint32_t	filesz;
+	uint32_t	memsz;
+	uint8_t		*dst;
+#ifdef USE_FIT
+	int		check_crc;
+	uint32_t	hash;		/* expected CRC32 */
+	uint32_t	crc;		/* of the data received so far */
+#endif
+};
+
+static struct image_segment segments[IMAGE_MAX_SEGMENTS];
+static unsigned int nb_segments;
+
+#ifdef USE_FIT
+enum {
+	FIT_NONE,
+	FIT_TREE,		/* waiting for the end of the tree */
+	FIT_LOADED,		/* components placed */
+	FIT_FAILED,
+};
+
+static int fit_state;
+static uint32_t fit_tree_size;
+static void **fit_exec_addr;
+#endif
+
+#ifdef STAGE2
+int overlaps_loader(const void *start, uint32_t size)
+{
+	extern char _start[], __stack[];
+	uint32_t addr = (uint32_t) start & 0x1fffffff;
+
+	if (addr < ((uint32_t) __stack & 0x1fffffff)
+	    && ((uint32_t) _start & 0x1fffffff) < addr + size) {
+		SERIAL_ERR(ERR_STAGE2_OVERLAP);
+		return 1;
+	}
+
+	return 0;
+}
+#endif
+
+static int segments_overlap_loader(unsigned int first)
+{
+	unsigned int i;
+
+	for (i = first; i < nb_segments; i++) {
+		if (overlaps_loader(segments[i].dst, segments[i].memsz))
+			return 1;
+	}
+
+	return 0;
+}
+
 static int check_uimage(struct uimage_header *header)
 {
 	if (__bswap32(header->magic) != UIMAGE_MAGIC)
@@ -54,17 +169,270 @@ static int check_uimage(struct uimage_header *header)
 	return 0;
 }
 
-void *process_uimage_header(struct uimage_header *header,
-			    void **exec_addr, unsigned int data_size)
+static int process_uimage_header(struct uimage_header *header,
+				 void **exec_addr)
+{
+	if (check_uimage(header))
+		return -1;
+
+	segments[0].offset = sizeof(*header);
+	segments[0].filesz = __bswap32(header->size);
+	segments[0].memsz = segments[0].filesz;
+	segments[0].dst = (uint8_t *) LOADADDR(__bswap32(header->load));
+	nb_segments = 1;
+
+	*exec_addr = (void *) __bswap32(header->ep);
+	return 0;
+}
+
+static int process_elf_header(struct elf32_ehdr *ehdr, void **exec_addr,
+			      unsigned int data_size)
+{
+	struct elf32_phdr *phdr;
+	unsigned int i;
+
+	if (ehdr->e_class != ELF_CLASS_32 || ehdr->e_data != ELF_DATA_LSB
+			|| ehdr->e_type != ELF_TYPE_EXEC
+			|| ehdr->e_machine != ELF_MACHINE_MIPS
+			|| ehdr->e_phentsize != sizeof(*phdr))
+		return -1;
+
+	/* The program headers must be in the first block. */
+	if (ehdr->e_phoff + ehdr->e_phnum * sizeof(*phdr) > data_size)
+		return -1;
+
+	phdr = (void *) ehdr + ehdr->e_phoff;
+	nb_segments = 0;
+
+	for (i = 0; i < ehdr->e_phnum; i++, phdr++) {
+		if (phdr->p_type != ELF_PT_LOAD || !phdr->p_memsz)
+			continue;
+
+		if (nb_segments == IMAGE_MAX_SEGMENTS
+				|| phdr->p_filesz > phdr->p_memsz)
+			return -1;
+
+		segments[nb_segments].offset = phdr->p_offset;
+		segments[nb_segments].filesz = phdr->p_filesz;
+		segments[nb_segments].memsz = phdr->p_memsz;
+		segments[nb_segments].dst =
+				(uint8_t *) LOADADDR(phdr->p_paddr);
+		nb_segments++;
+	}
+
+	if (!nb_segments)
+		return -1;
+
+	*exec_addr = (void *) ehdr->e_entry;
+	return 0;
+}
+
+int process_image_header(void *header, void **exec_addr,
+			 unsigned int data_size)
 {
-	if (check_uimage(header)) {
-		return NULL;
-	} else {
-		void *ld_addr = (void *) KSEG1ADDR(__bswap32(header->load));
-		void *body = (void *) header + sizeof(struct uimage_header);
-		size_t move_size = data_size - sizeof(struct uimage_header);
-		*exec_addr = (void *) __bswap32(header->ep);
-		memmove(ld_addr, body, move_size);
-		return ld_addr + move_size;
+	int err;
+
+	if (*(uint32_t *) header == ELF_MAGIC)
+		err = process_elf_header(header, exec_addr, data_size);
+	else
+		err = process_uimage_header(header, exec_addr);
+
+	if (!err && segments_overlap_loader(0))
+		err = -1;
+
+#ifdef USE_FIT
+	unsigned int i;
+
+	for (i = 0; i < nb_segments; i++)
+		segments[i].check_crc = 0;
+	fit_state = FIT_NONE;
+#endif
+
+	if (!err)
+		image_scatter(0, header, data_size);
+
+	return err;
+}
+
+#ifdef USE_FIT
+int process_fit_header(void *header, void **exec_addr,
+		       unsigned int data_size)
+{
+	const struct fdt_header *hdr = header;
+
+	if (__bswap32(hdr->magic) != FDT_MAGIC
+	    || __bswap32(hdr->totalsize) < sizeof(*hdr))
+		return -1;
+
+	/* The tree is staged at the load area until it is complete. */
+	fit_tree_size = __bswap32(hdr->totalsize);
+	fit_exec_addr = exec_addr;
+	fit_state = FIT_TREE;
+
+	segments[0].offset = 0;
+	segments[0].filesz = fit_tree_size;
+	segments[0].memsz = fit_tree_size;
+	segments[0].dst = (uint8_t *) LOADADDR(LD_ADDR);
+	segments[0].check_crc = 0;
+	nb_segments = 1;
+
+	if (segments_overlap_loader(0))
+		return -1;
+
+	image_scatter(0, header, data_size);
+	return 0;
+}
+
+int image_add_segment(uint32_t offset, uint32_t size, void *dst,
+		      int check_crc, uint32_t hash)
+{
+	struct image_segment *seg = &segments[nb_segments];
+
+	if (nb_segments == IMAGE_MAX_SEGMENTS || overlaps_loader(dst, size))
+		return -1;
+
+	seg->offset = offset;
+	seg->filesz = size;
+	seg->memsz = size;
+	seg->dst = dst;
+	seg->check_crc = check_crc;
+	seg->hash = hash;
+	seg->crc = ~0;
+	nb_segments++;
+	return 0;
+}
+#endif
+
+void *image_block_addr(uint32_t offset, unsigned int size)
+{
+	unsigned int i;
+
+	for (i = 0; i < nb_segments; i++) {
+		struct image_segment *seg = &segments[i];
+
+		if (offset >= seg->offset
+				&& offset + size <= seg->offset + seg->filesz) {
+			uint8_t *dst = seg->dst + (offset - seg->offset);
+
+			/* Blocks are received one word at a time. */
+			return ((uint32_t) dst & 3) ? NULL : dst;
+		}
+	}
+
+	return NULL;
+}
+
+static void scatter(unsigned int first, uint32_t offset,
+		    const void *block, unsigned int size)
+{
+	unsigned int i;
+
+	for (i = first; i < nb_segments; i++) {
+		struct image_segment *seg = &segments[i];
+		uint32_t start = offset > seg->offset ? offset : seg->offset;
+		uint32_t end = offset + size;
+		uint8_t *dst = seg->dst + (start - seg->offset);
+		const void *src = block + (start - offset);
+
+		if (end > seg->offset + seg->filesz)
+			end = seg->offset + seg->filesz;
+
+		if (start >= end)
+			continue;
+
+		/* Blocks received in place are only accounted for. */
+		if (dst != src)
+			memcpy(dst, src, end - start);
+
+#ifdef USE_FIT
+		if (seg->check_crc)
+			seg->crc = crc32(seg->crc, src, end - start);
+#endif
+	}
+}
+
+void image_scatter(uint32_t offset, const void *block, unsigned int size)
+{
+#ifdef USE_FIT
+	unsigned int first = nb_segments;
+#endif
+
+	scatter(0, offset, block, size);
+
+#ifdef USE_FIT
+	/* The components of a FIT image are only known once its tree is
+	 * complete; the rest of the block may belong to them. */
+	if (fit_state == FIT_TREE && offset + size >= fit_tree_size) {
+		if (fit_process_tree(segments[0].dst, fit_exec_addr)) {
+			fit_state = FIT_FAILED;
+			return;
+		}
+
+		fit_state = FIT_LOADED;
+		scatter(first, offset, block, size);
+	}
+#endif
+}
+
+uint32_t image_size(void)
+{
+	uint32_t size = 0;
+	unsigned int i;
+
+	for (i = 0; i < nb_segments; i++) {
+		if (size < segments[i].offset + segments[i].filesz)
+			size = segments[i].offset + segments[i].filesz;
+	}
+
+	return size;
+}
+
+int image_finish(uint32_t size)
+{
+	uint8_t *start = segments[0].dst, *end = start;
+	unsigned int i;
+
+	for (i = 0; i < nb_segments; i++) {
+		struct image_segment *seg = &segments[i];
+
+		if (size < seg->offset + seg->filesz)
+			goto err;
+
+#ifdef USE_FIT
+		if (seg->check_crc && ~seg->crc != seg->hash) {
+			SERIAL_ERR(ERR_FIT_BAD_HASH);
+			goto err;
+		}
+#endif
+
+		/* Clear the BSS */
+		memset(seg->dst + seg->filesz, 0, seg->memsz - seg->filesz);
+
+		if (start > seg->dst)
+			start = seg->dst;
+		if (end < seg->dst + seg->memsz)
+			end = seg->dst + seg->memsz;
+	}
+
+#ifdef USE_FIT
+	/* The FIT loader knows which segment holds the kernel. */
+	if (fit_state == FIT_LOADED)
+		return 0;
+	if (fit_state != FIT_NONE)
+		goto err;
+#endif
+
+	set_boot_kernel(start, end - start);
+	return 0;
+
+err:
+#ifdef USE_FIT
+	/* Don't pass on what a rejected FIT image came with. */
+	if (fit_state != FIT_NONE) {
+		boot_fdt = NULL;
+		boot_initrd = NULL;
+		boot_initrd_size = 0;
 	}
+#endif
+	return -1;
 }
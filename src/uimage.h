@@ -1,9 +1,82 @@
 #ifndef UIMAGE_H
 #define UIMAGE_H
 
-struct uimage_header;
+#include <stdint.h>
 
-void *process_uimage_header(struct uimage_header *header,
-			    void **exec_addr, unsigned int data_size);
+/*
+ * Kernel images are streamed block by block, in file order. The first block
+ * is parsed by process_image_header(), which accepts uImage and ELF kernels
+ * and writes the entry point to 'exec_addr'. Returns 0 if the header was
+ * accepted.
+ */
+int process_image_header(void *header, void **exec_addr,
+			 unsigned int data_size);
+
+#ifdef USE_FIT
+/*
+ * Same, for FIT images (FAT loader only). The tree is staged at LD_ADDR,
+ * then fit_process_tree() places the components. Blocks must be received in
+ * file order, and those received in place passed to image_scatter() too.
+ */
+int process_fit_header(void *header, void **exec_addr,
+		       unsigned int data_size);
+
+/*
+ * Adds a segment to the image, for fit_process_tree(). If 'check_crc' is
+ * set, the data must match the CRC32 'hash' for image_finish() to succeed.
+ */
+int image_add_segment(uint32_t offset, uint32_t size, void *dst,
+		      int check_crc, uint32_t hash);
+#else
+#define process_fit_header(header, exec_addr, data_size) (-1)
+#endif
+
+/*
+ * Returns where the 'size' bytes found at 'offset' in the image file can be
+ * received directly, or NULL if they do not belong to a single segment of the
+ * image; they must then be read to a scratch buffer and passed to
+ * image_scatter(), which copies whatever parts of them must be loaded.
+ */
+void *image_block_addr(uint32_t offset, unsigned int size);
+void image_scatter(uint32_t offset, const void *block, unsigned int size);
+
+/* Returns how much of the image file must be read to load all segments. */
+uint32_t image_size(void);
+
+/*
+ * To be called once the first 'size' bytes of the image file were received.
+ * Clears the BSS, and returns 0 if the image was loaded completely.
+ */
+int image_finish(uint32_t size);
+
+#ifdef STAGE2
+/*
+ * Stage 2 runs from the SDRAM, where the images are loaded too. Returns
+ * non-zero, and reports it, if 'size' bytes at 'start' would overwrite its
+ * code, data or stack.
+ */
+int overlaps_loader(const void *start, uint32_t size);
+#else
+#define overlaps_loader(start, size) 0
+#endif
+
+/*
+ * Images handed over to the kernel besides the kernel itself, filled in by
+ * the loaders that support them. Addresses are in LOAD_SEG.
+ */
+extern void *boot_fdt;
+extern void *boot_initrd;
+extern uint32_t boot_initrd_size;
+
+#ifdef USE_CACHED_LOAD
+/* Memory the kernel was loaded to, for the final cache flush */
+extern void *boot_kernel;
+extern uint32_t boot_kernel_size;
+
+#define set_boot_kernel(addr, size) \
+	do { boot_kernel = (addr); boot_kernel_size = (size); } while (0)
+#else
+#define set_boot_kernel(addr, size) do { (void)(addr); (void)(size); } while (0)
+#endif
 
 #endif
@@ -16,6 +16,15 @@ int strncmp(const char *s1, const char *s2, size_t n)
 	return 0;
 }
 
+size_t strlen(const char *s)
+{
+	const char *p = s;
+
+	while (*p)
+		p++;
+	return p - s;
+}
+
 void __attribute__((used)) *memcpy(void *dest, const void *src, size_t n)
 {
 	unsigned char *d = dest;
@@ -26,6 +35,15 @@ void __attribute__((used)) *memcpy(void *dest, const void *src, size_t n)
 	return dest;
 }
 
+void __attribute__((used)) *memset(void *s, int c, size_t n)
+{
+	unsigned char *d = s, *e = s + n;
+
+	while (d != e)
+		*d++ = c;
+	return s;
+}
+
 void *memmove(void *dest, const void *src, size_t n)
 {
 	if (dest <= src || src + n <= dest) {
@@ -52,9 +70,9 @@ void write_hex_digits(unsigned int value, char *last_digit)
 	} while (value && (*ptr != 'x'));
 }
 
-void udelay(unsigned int us)
+/* Two cycles per loop */
+static void delay_loops(unsigned int tmp)
 {
-	unsigned int tmp = (CFG_CPU_SPEED / 1000000 / 2) * us;
 	asm volatile (
 		".set noreorder\n\t"
 		"0:\n\t"
@@ -65,6 +83,16 @@ void udelay(unsigned int us)
 		);
 }
 
+void udelay(unsigned int us)
+{
+	delay_loops((CFG_CPU_SPEED / 1000000 / 2) * us);
+}
+
+void ndelay(unsigned int ns)
+{
+	delay_loops((CFG_CPU_SPEED / 1000000 * ns + 1999) / 2000);
+}
+
 bool ram_works(void)
 {
 	unsigned int i;
@@ -80,6 +108,34 @@ bool ram_works(void)
 	return true;
 }
 
+#ifdef USE_CACHED_LOAD
+void cache_save_loader(void)
+{
+	extern unsigned int __stack;
+	volatile u32 *ptr;
+
+	/* Storing to a line marks it dirty, so that the writeback happens.
+	 * Invalidating each line once saved leaves a free way to any miss
+	 * that follows, so that no line still to be saved gets evicted. */
+	for (ptr = (u32 *) KSEG0; ptr < &__stack;
+			ptr += CFG_CACHELINE_SIZE / 4) {
+		*ptr = *ptr;
+		cache_unroll(ptr, Hit_Writeback_Inv_D);
+	}
+
+	jz_sync();
+}
+#endif
+
+uint16_t __bswap16(uint16_t val)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return (val >> 8) | (val << 8);
+#else
+	return val;
+#endif
+}
+
 uint32_t __bswap32(uint32_t val)
 {
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
@@ -107,3 +163,53 @@ uint64_t __bswap64(uint64_t val)
 	return val;
 #endif
 }
+
+#ifdef USE_CACHE_RAM
+static uint32_t crc32_table[256] __cache_ram;
+static bool crc32_table_ready;
+
+uint32_t crc32(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	unsigned int i, j;
+
+	/* The usual byte-wise table, built on first use: there is room for
+	 * it in the cache RAM. */
+	if (!crc32_table_ready) {
+		for (i = 0; i < 256; i++) {
+			uint32_t val = i;
+
+			for (j = 0; j < 8; j++)
+				val = (val >> 1) ^ (val & 1 ? 0xedb88320 : 0);
+			crc32_table[i] = val;
+		}
+		crc32_table_ready = true;
+	}
+
+	while (len--)
+		crc = (crc >> 8) ^ crc32_table[(crc ^ *p++) & 0xff];
+
+	return crc;
+}
+#else
+uint32_t crc32(uint32_t crc, const void *buf, size_t len)
+{
+	/* Nibble-wise table: a good compromise between the speed of the
+	 * usual 1 KiB table and the size of the bitwise loop. */
+	static const uint32_t crc32_table[16] = {
+		0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+		0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+		0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+		0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+	};
+	const uint8_t *p = buf;
+
+	while (len--) {
+		crc ^= *p++;
+		crc = (crc >> 4) ^ crc32_table[crc & 0xf];
+		crc = (crc >> 4) ^ crc32_table[crc & 0xf];
+	}
+
+	return crc;
+}
+#endif
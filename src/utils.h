@@ -7,11 +7,19 @@
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
+#ifdef USE_CACHE_RAM
+/* For data in the cache lines head.S sets up as RAM: not cleared. */
+#define __cache_ram __attribute__((section(".cache_ram")))
+#endif
+
 int strncmp(const char *s1, const char *s2, size_t n);
+size_t strlen(const char *s);
 
 void *memcpy(void *dest, const void *src, size_t n);
 void *memmove(void *dest, const void *src, size_t n);
+void *memset(void *s, int c, size_t n);
 
+uint16_t __bswap16(uint16_t x);
 uint32_t __bswap32(uint32_t x);
 uint64_t __bswap64(uint64_t x);
 
@@ -25,10 +33,29 @@ uint64_t __bswap64(uint64_t x);
  */
 void write_hex_digits(unsigned int value, char *last_digit);
 
+/*
+ * Updates a CRC-32 (IEEE 802.3 polynomial, reflected) with 'len' bytes.
+ * No inversion is done on input or output: the usual zlib-style checksum
+ * is ~crc32(~0, buf, len), while UBI uses crc32(~0, buf, len) directly.
+ */
+uint32_t crc32(uint32_t crc, const void *buf, size_t len);
+
 void udelay(unsigned int us);
+void ndelay(unsigned int ns);
 
 bool ram_works(void);
 
+#ifdef USE_CACHED_LOAD
+/*
+ * The boot ROM leaves the loader in clean data cache lines, which would be
+ * lost if evicted. Copies them to the SDRAM, so that loads through kseg0 can
+ * evict them.
+ */
+void cache_save_loader(void);
+#else
+#define cache_save_loader() do { } while (0)
+#endif
+
 inline unsigned int div_round_up(unsigned int nb, unsigned int div)
 {
 	return (nb / div) + !!(nb % div);
@@ -0,0 +1,136 @@
+/*
+ * Warm reboot: when the RAM kept its content, the kernel image of the
+ * previous boot is booted again without loading it.
+ *
+ * Only an image that the running kernel leaves alone can be reused: a
+ * self-decompressing vmlinuz.bin at LD_ADDR, which unpacks the kernel below
+ * itself. The kernel is told to keep out of that image and of the record
+ * right below it; anything it ran in place, or freed after boot, is gone.
+ *
+ * A new kernel file is usually installed right before a reboot, which is a
+ * watchdog reset too: the card is checked to still hold the same file, which
+ * costs a FAT mount but not the load.
+ */
+
+#include <stdint.h>
+
+#include "config.h"
+#include "fat.h"
+#include "jz.h"
+#include "mmc.h"
+#include "uimage.h"
+#include "utils.h"
+#include "warmboot.h"
+
+#if JZ_VERSION >= 4770
+#include "jz4770-cpm.h"
+#elif JZ_VERSION >= 4760
+#include "jz4760-cpm.h"
+#else
+#include "jz4740-cpm.h"
+#endif
+
+#define WARM_MAGIC	0x4d524157	/* "WARM" */
+
+struct warm_record {
+	uint32_t magic;
+	uint32_t generation;	/* number of times the image was reused */
+	uint32_t source;
+	uint32_t flags;
+	void *exec_addr;
+	uint32_t image_size;
+	uint32_t image_crc;
+	uint32_t kernel_crc;	/* of the file; see mmc_kernel_crc() */
+	uint32_t crc;		/* of all the fields above */
+};
+
+#define WARM_RECORD	((struct warm_record *) (KSEG1 + LD_ADDR) - 1)
+
+static uint32_t generation, kept_size, kept_crc;
+
+static uint32_t record_crc(const struct warm_record *rec)
+{
+	return crc32(0xffffffff, rec, offsetof(struct warm_record, crc));
+}
+
+#ifdef STAGE2_WARMBOOT
+int warm_pending(void)
+{
+	const struct warm_record *rec = WARM_RECORD;
+	uint32_t rsr = REG_CPM_RSR;
+
+	return (rsr & CPM_RSR_WR) && !(rsr & CPM_RSR_PR)
+		&& rec->magic == WARM_MAGIC && rec->crc == record_crc(rec);
+}
+#else
+void *warm_boot(unsigned int *source, unsigned int *flags)
+{
+	struct warm_record *rec = WARM_RECORD;
+	uint32_t rsr = REG_CPM_RSR, crc;
+	void *dir;
+
+	/* The status bits stay set until cleared. */
+	REG_CPM_RSR = 0;
+
+	if (rec->magic != WARM_MAGIC || rec->crc != record_crc(rec))
+		return NULL;
+	rec->magic = 0;
+
+	if (!(rsr & CPM_RSR_WR) || (rsr & CPM_RSR_PR))
+		return NULL;
+
+	if (crc32(0xffffffff, (void *) (KSEG1 + LD_ADDR),
+		  rec->image_size) != rec->image_crc)
+		return NULL;
+
+	/* The root directory is read above the image. */
+	dir = (void *) (LOAD_SEG
+			+ ((LD_ADDR + rec->image_size + 0xfff) & ~0xfff));
+	if (rec->source == WARM_SOURCE_NAND || mmc_init(rec->source)
+	    || mmc_kernel_crc(rec->source, dir, &crc) || crc != rec->kernel_crc)
+		return NULL;
+
+	generation = rec->generation + 1;
+	kept_size = rec->image_size;
+	kept_crc = crc;
+	set_boot_kernel((void *) (LOAD_SEG + LD_ADDR), kept_size);
+
+	*source = rec->source;
+	*flags = rec->flags;
+	return rec->exec_addr;
+}
+
+void warm_keep_image(uint32_t size, uint32_t kernel_crc)
+{
+	kept_size = size;
+	kept_crc = kernel_crc;
+}
+
+uint32_t warm_reserved_end(void)
+{
+	return kept_size ? (LD_ADDR + kept_size + 0xfff) & ~0xfff : 0;
+}
+
+void warm_save(void *exec_addr, unsigned int source, unsigned int flags)
+{
+	struct warm_record *rec = WARM_RECORD;
+
+	rec->magic = 0;
+
+	/* The kernel may overwrite everything else. */
+	if (!kept_size || boot_initrd || boot_fdt)
+		return;
+
+	rec->generation = generation;
+	rec->source = source;
+	rec->flags = flags;
+	rec->exec_addr = exec_addr;
+	rec->image_size = kept_size;
+	rec->image_crc = crc32(0xffffffff, (void *) (LOAD_SEG + LD_ADDR),
+			       kept_size);
+	rec->kernel_crc = kept_crc;
+
+	rec->magic = WARM_MAGIC;
+	rec->crc = record_crc(rec);
+}
+#endif /* STAGE2_WARMBOOT */
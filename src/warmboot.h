@@ -0,0 +1,57 @@
+#ifndef WARMBOOT_H
+#define WARMBOOT_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+/* Where the kernel was loaded from: the MMC ID, or NAND */
+#define WARM_SOURCE_NAND	0xff
+
+#define WARM_FLAG_ALT		(1 << 0)	/* backup kernel */
+
+/* Physical start of the memory the kernel must keep out of: the record,
+ * then the image at LD_ADDR. */
+#define WARM_RESERVED_START	(LD_ADDR - 0x1000)
+
+#ifdef STAGE2_WARMBOOT
+/*
+ * Tells stage 1 that stage 2 will likely boot the previous kernel again,
+ * after a watchdog reset: the image at LD_ADDR must then be left untouched.
+ */
+int warm_pending(void);
+#else
+/*
+ * After a watchdog reset, the way Linux reboots, checks the record left by
+ * the previous boot, the CRC of the image it lists, and that the card still
+ * holds the kernel file the image was loaded from. If they match, returns
+ * the entry point of the kernel, along with its source and flags. Returns
+ * NULL otherwise. The record is dropped either way.
+ */
+void *warm_boot(unsigned int *source, unsigned int *flags);
+
+/*
+ * Returns the physical end of the memory the kernel must keep out of,
+ * starting from WARM_RESERVED_START, or 0 if no image is kept.
+ */
+uint32_t warm_reserved_end(void);
+
+/*
+ * Records the kept image about to be booted, if any; to be called last, as
+ * the CRC of the image is computed then.
+ */
+void warm_save(void *exec_addr, unsigned int source, unsigned int flags);
+#endif
+
+#ifdef USE_WARMBOOT
+/*
+ * Marks the 'size' bytes loaded at LD_ADDR as an image that can be booted
+ * again: a kernel file that doesn't run in place, identified on the card by
+ * 'kernel_crc' (see mmc_kernel_crc()).
+ */
+void warm_keep_image(uint32_t size, uint32_t kernel_crc);
+#else
+#define warm_keep_image(size, kernel_crc) do { (void)(size); } while (0)
+#endif
+
+#endif /* WARMBOOT_H */
@@ -0,0 +1,68 @@
+/*
+ * Host versions of the helpers from utils.c and serial.c, for the tools
+ * that build the bootloader sources natively.
+ */
+
+#include <stdio.h>
+
+#include "serial.h"
+#include "utils.h"
+
+/* The bootloader only gets it inlined. */
+extern inline unsigned int div_round_up(unsigned int nb, unsigned int div);
+
+/* Bitwise, unlike the table-driven one of utils.c: both must agree. */
+uint32_t crc32(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	unsigned int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+	}
+
+	return crc;
+}
+
+uint16_t __bswap16(uint16_t x)
+{
+	return __builtin_bswap16(x);
+}
+
+uint32_t __bswap32(uint32_t x)
+{
+	return __builtin_bswap32(x);
+}
+
+uint64_t __bswap64(uint64_t x)
+{
+	return __builtin_bswap64(x);
+}
+
+int serial_quiet;
+
+void serial_putc(const char c)
+{
+	if (!serial_quiet)
+		putchar(c);
+}
+
+void serial_puts(const char *s)
+{
+	if (!serial_quiet)
+		fputs(s, stdout);
+}
+
+void serial_puti(unsigned int d)
+{
+	if (!serial_quiet)
+		printf("%u", d);
+}
+
+void serial_puth(unsigned int d)
+{
+	if (!serial_quiet)
+		printf("0x%08x", d);
+}
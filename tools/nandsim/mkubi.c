@@ -0,0 +1,533 @@
+/*
+ * Writes a raw NAND image, OOB data included, holding a UBI partition laid
+ * out for the board: the volumes given on the command line, the layout
+ * volume, and optionally a fastmap. Programmed pages get zeroed parity
+ * bytes, which nandsim replaces with its own tags.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "ubi.h"
+#include "utils.h"
+
+#define OOB_SIZE	(PAGE_SIZE / 32)
+#define RAW_PAGE_SIZE	(PAGE_SIZE + OOB_SIZE)
+#define RAW_BLOCK_SIZE	(PAGE_PER_BLOCK * RAW_PAGE_SIZE)
+
+/* Volume types, as found in the volume table and fastmap */
+#define UBI_DYNAMIC_VOLUME	3
+#define UBI_STATIC_VOLUME	4
+
+#define UBI_COMPAT_DELETE	1
+#define UBI_COMPAT_REJECT	5
+
+#define UBI_LAYOUT_VOLUME_EBS	2
+#define IMAGE_SEQ		0x55424942
+
+#define MAX_VOLUMES	16
+#define MAX_BAD		64
+
+struct volume {
+	const char *name;
+	uint8_t *data;
+	size_t size;
+	uint32_t vol_id;
+	uint8_t vid_type;		/* UBI_VID_* */
+	uint32_t nb_lebs;
+	uint32_t *pebs;			/* UBI_NO_PEB if not in the fastmap */
+};
+
+static struct volume volumes[MAX_VOLUMES + 1];
+static unsigned int nb_volumes;
+
+static uint32_t eb_start = UBI_MTD_EB_START, nb_ebs = UBI_MTD_NB_EB;
+static uint32_t vid_hdr_offset = PAGE_SIZE, data_offset, leb_size;
+static uint8_t *image;
+static uint64_t sqnum = 1;
+
+/* PEBs of the partition not written yet, in allocation order */
+static uint32_t *free_pebs, nb_free;
+
+static void fail(const char *msg, const char *arg)
+{
+	fprintf(stderr, "mkubi: %s%s\n", msg, arg ? arg : "");
+	exit(1);
+}
+
+static uint8_t *raw_page(uint32_t peb, uint32_t page)
+{
+	return image + (size_t)(eb_start + peb) * RAW_BLOCK_SIZE
+		+ page * RAW_PAGE_SIZE;
+}
+
+/* Stores 'len' bytes at 'offset' of the data area of the PEB. */
+static void peb_write(uint32_t peb, uint32_t offset, const void *buf,
+		      size_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len) {
+		uint32_t page = offset / PAGE_SIZE, col = offset % PAGE_SIZE;
+		size_t n = PAGE_SIZE - col < len ? PAGE_SIZE - col : len;
+		uint8_t *dst = raw_page(peb, page);
+
+		memcpy(dst + col, p, n);
+		memset(dst + PAGE_SIZE + ECC_POS, 0,
+		       PAR_SIZE * (PAGE_SIZE / ECC_BLOCK));
+
+		p += n;
+		offset += n;
+		len -= n;
+	}
+}
+
+static void write_ec_hdr(uint32_t peb)
+{
+	struct ubi_ec_hdr hdr = { 0 };
+
+	hdr.magic = UBI_EC_HDR_MAGIC;
+	hdr.version = 1;
+	hdr.vid_hdr_offset = __bswap32(vid_hdr_offset);
+	hdr.data_offset = __bswap32(data_offset);
+	hdr.image_seq = __bswap32(IMAGE_SEQ);
+	hdr.hdr_crc = __bswap32(crc32(UBI_CRC32_INIT, &hdr, sizeof(hdr) - 4));
+
+	peb_write(peb, 0, &hdr, sizeof(hdr));
+}
+
+/* Writes a LEB to the next free PEB and returns the latter. */
+static uint32_t write_leb(uint32_t vol_id, uint8_t vid_type, uint8_t compat,
+			  uint32_t lnum, const void *data, uint32_t len,
+			  uint32_t used_ebs)
+{
+	struct ubi_vid_hdr hdr = { 0 };
+	uint32_t peb;
+
+	if (!nb_free)
+		fail("the partition is full", NULL);
+	peb = *free_pebs++;
+	nb_free--;
+
+	hdr.magic = UBI_VID_HDR_MAGIC;
+	hdr.version = 1;
+	hdr.vol_type = vid_type;
+	hdr.compat = compat;
+	hdr.vol_id = __bswap32(vol_id);
+	hdr.lnum = __bswap32(lnum);
+	hdr.sqnum = __bswap64(sqnum++);
+
+	if (vid_type == UBI_VID_STATIC) {
+		hdr.data_size = __bswap32(len);
+		hdr.used_ebs = __bswap32(used_ebs);
+		hdr.data_crc = __bswap32(crc32(UBI_CRC32_INIT, data, len));
+	}
+
+	hdr.hdr_crc = __bswap32(crc32(UBI_CRC32_INIT, &hdr, sizeof(hdr) - 4));
+
+	peb_write(peb, vid_hdr_offset, &hdr, sizeof(hdr));
+	peb_write(peb, data_offset, data, len);
+	return peb;
+}
+
+static uint32_t vtbl_size(void)
+{
+	uint32_t nb = leb_size / sizeof(struct ubi_vol_tbl_record);
+
+	return (nb < UBI_MAX_VOLUMES ? nb : UBI_MAX_VOLUMES)
+		* sizeof(struct ubi_vol_tbl_record);
+}
+
+static void write_layout_volume(struct volume *layout)
+{
+	struct ubi_vol_tbl_record *vtbl = calloc(1, vtbl_size());
+	unsigned int i;
+
+	for (i = 0; i < vtbl_size() / sizeof(*vtbl); i++) {
+		struct ubi_vol_tbl_record *rec = &vtbl[i];
+
+		if (i < nb_volumes) {
+			struct volume *vol = &volumes[i];
+
+			rec->reserved_pebs = __bswap32(vol->nb_lebs);
+			rec->alignment = __bswap32(1);
+			rec->vol_type = vol->vid_type == UBI_VID_STATIC
+				? UBI_STATIC_VOLUME : UBI_DYNAMIC_VOLUME;
+			rec->name_len = __bswap16(strlen(vol->name));
+			strcpy((char *)rec->name, vol->name);
+		}
+
+		rec->crc = __bswap32(crc32(UBI_CRC32_INIT, rec,
+					   sizeof(*rec) - 4));
+	}
+
+	for (i = 0; i < UBI_LAYOUT_VOLUME_EBS; i++)
+		layout->pebs[i] = write_leb(UBI_VOL_TABLE_ID, UBI_VID_DYNAMIC,
+					    UBI_COMPAT_REJECT, i, vtbl,
+					    vtbl_size(), 0);
+	free(vtbl);
+}
+
+static void write_volume(struct volume *vol, uint32_t skip)
+{
+	uint32_t i;
+
+	for (i = skip; i < vol->nb_lebs; i++) {
+		uint32_t offset = i * leb_size;
+		uint32_t len = vol->size - offset < leb_size
+			? vol->size - offset : leb_size;
+
+		vol->pebs[i] = write_leb(vol->vol_id, vol->vid_type, 0, i,
+					 vol->data + offset, len, vol->nb_lebs);
+	}
+}
+
+/*
+ * The fastmap: super block, header, pools, lists of free and used PEBs,
+ * then the EBA table of each volume. PEBs written after it are only found
+ * through its pool.
+ */
+static void write_fastmap(uint32_t anchor, const uint32_t *pool,
+			  uint32_t pool_size, const uint8_t *used,
+			  uint32_t nb_bad)
+{
+	size_t size = sizeof(struct ubi_fm_sb) + sizeof(struct ubi_fm_hdr)
+		+ 2 * sizeof(struct ubi_fm_scan_pool)
+		+ nb_ebs * sizeof(struct ubi_fm_ec);
+	struct ubi_fm_scan_pool *pools;
+	struct ubi_fm_hdr *fmhdr;
+	struct ubi_fm_sb *fmsb;
+	struct ubi_fm_ec *ec;
+	uint32_t i, j, nb_used = 0, nb_free_pebs = 0, used_blocks;
+	uint8_t *fm, *p;
+
+	for (i = 0; i <= nb_volumes; i++)
+		size += sizeof(struct ubi_fm_volhdr) + sizeof(struct ubi_fm_eba)
+			+ volumes[i].nb_lebs * 4;
+
+	used_blocks = div_round_up(size, leb_size);
+	if (used_blocks > UBI_FM_MAX_BLOCKS)
+		fail("the fastmap is too large", NULL);
+
+	fm = calloc(used_blocks, leb_size);
+	fmsb = (struct ubi_fm_sb *)fm;
+	fmhdr = (struct ubi_fm_hdr *)(fmsb + 1);
+	pools = (struct ubi_fm_scan_pool *)(fmhdr + 1);
+
+	/* The blocks of the fastmap itself go first. */
+	fmsb->magic = __bswap32(UBI_FM_SB_MAGIC);
+	fmsb->version = UBI_FM_FMT_VERSION;
+	fmsb->used_blocks = __bswap32(used_blocks);
+	fmsb->block_loc[0] = __bswap32(anchor);
+	for (i = 1; i < used_blocks; i++) {
+		if (!nb_free)
+			fail("no room left for the fastmap", NULL);
+		fmsb->block_loc[i] = __bswap32(free_pebs[--nb_free]);
+	}
+	fmsb->sqnum = __bswap64(sqnum);
+
+	fmhdr->magic = __bswap32(UBI_FM_HDR_MAGIC);
+	fmhdr->bad_peb_count = __bswap32(nb_bad);
+	fmhdr->vol_count = __bswap32(nb_volumes + 1);
+
+	pools[0].magic = pools[1].magic = __bswap32(UBI_FM_POOL_MAGIC);
+	pools[0].size = __bswap16(pool_size);
+	pools[0].max_size = pools[1].max_size =
+		__bswap16(UBI_FM_MAX_POOL_SIZE);
+	for (i = 0; i < pool_size; i++)
+		pools[0].pebs[i] = __bswap32(pool[i]);
+
+	/* Free PEBs, then used ones */
+	ec = (struct ubi_fm_ec *)(pools + 2);
+	for (i = 0; i < nb_free; i++, nb_free_pebs++)
+		(ec++)->pnum = __bswap32(free_pebs[i]);
+	for (i = 0; i < nb_ebs; i++) {
+		if (used[i]) {
+			(ec++)->pnum = __bswap32(i);
+			nb_used++;
+		}
+	}
+	fmhdr->free_peb_count = __bswap32(nb_free_pebs);
+	fmhdr->used_peb_count = __bswap32(nb_used);
+
+	p = (uint8_t *)ec;
+	for (i = 0; i <= nb_volumes; i++) {
+		struct volume *vol = &volumes[i];
+		struct ubi_fm_volhdr *volhdr = (struct ubi_fm_volhdr *)p;
+		struct ubi_fm_eba *eba = (struct ubi_fm_eba *)(volhdr + 1);
+		uint32_t last = vol->size - (vol->nb_lebs - 1) * leb_size;
+
+		volhdr->magic = __bswap32(UBI_FM_VHDR_MAGIC);
+		volhdr->vol_id = __bswap32(vol->vol_id);
+		volhdr->vol_type = vol->vid_type == UBI_VID_STATIC
+			? UBI_STATIC_VOLUME : UBI_DYNAMIC_VOLUME;
+		volhdr->used_ebs = __bswap32(vol->nb_lebs);
+		volhdr->last_eb_bytes = __bswap32(vol->vid_type
+						  == UBI_VID_STATIC
+						  ? last : leb_size);
+
+		eba->magic = __bswap32(UBI_FM_EBA_MAGIC);
+		eba->reserved_pebs = __bswap32(vol->nb_lebs);
+		for (j = 0; j < vol->nb_lebs; j++)
+			eba->pnum[j] = __bswap32(vol->pebs[j]);
+
+		p = (uint8_t *)&eba->pnum[vol->nb_lebs];
+	}
+
+	fmsb->data_crc = __bswap32(crc32(UBI_CRC32_INIT, fm,
+					 used_blocks * leb_size));
+
+	free_pebs = &anchor;
+	nb_free = 1;
+	write_leb(UBI_FM_SB_VOLUME_ID, UBI_VID_DYNAMIC, UBI_COMPAT_DELETE, 0,
+		  fm, leb_size, 0);
+
+	for (i = 1; i < used_blocks; i++) {
+		uint32_t peb = __bswap32(fmsb->block_loc[i]);
+
+		free_pebs = &peb;
+		nb_free = 1;
+		write_leb(UBI_FM_DATA_VOLUME_ID, UBI_VID_DYNAMIC,
+			  UBI_COMPAT_DELETE, i, fm + i * leb_size, leb_size, 0);
+	}
+
+	free(fm);
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *buf;
+	long len;
+
+	if (!f || fseek(f, 0, SEEK_END) || (len = ftell(f)) < 0)
+		fail("cannot read ", path);
+	rewind(f);
+
+	buf = malloc(len + 1);
+	if (!buf || fread(buf, 1, len, f) != (size_t)len)
+		fail("cannot read ", path);
+
+	fclose(f);
+	*size = len;
+	return buf;
+}
+
+static void add_volume(char *spec, uint8_t vid_type)
+{
+	struct volume *vol = &volumes[nb_volumes];
+	char *file = strchr(spec, '=');
+
+	if (!file || nb_volumes == MAX_VOLUMES)
+		fail("bad volume: ", spec);
+	*file++ = '\0';
+	if (strlen(spec) > UBI_VOL_NAME_MAX)
+		fail("name too long: ", spec);
+
+	vol->name = spec;
+	vol->data = read_file(file, &vol->size);
+	vol->vol_id = nb_volumes++;
+	vol->vid_type = vid_type;
+}
+
+static uint32_t xorshift32(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [options] -o IMAGE VOLUMES...\n\n"
+		"  -v NAME=FILE  add a static volume\n"
+		"  -d NAME=FILE  add a dynamic volume\n"
+		"  -e BLOCKS     first block of the partition (default: %u)\n"
+		"  -n BLOCKS     size of the partition (default: %u)\n"
+		"  -b BLOCK      mark BLOCK bad\n"
+		"  -O OFFSET     VID header offset (default: %u)\n"
+		"  -s SEED       allocate the PEBs in a random order\n"
+		"  -F            write a fastmap\n"
+		"  -p N          write the last N LEBs after the fastmap\n",
+		name, UBI_MTD_EB_START, UBI_MTD_NB_EB, PAGE_SIZE);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t bad[MAX_BAD], pool[UBI_FM_MAX_POOL_SIZE];
+	uint32_t i, j, nb_bad = 0, nb_bad_in = 0, seed = 0, pool_size = 0;
+	uint32_t anchor = UBI_NO_PEB, nb_blocks;
+	struct volume *layout = &volumes[MAX_VOLUMES];
+	const char *output = NULL;
+	uint32_t *pebs;
+	uint8_t *used;
+	int opt, fastmap = 0;
+	FILE *f;
+
+	while ((opt = getopt(argc, argv, "v:d:e:n:b:O:s:Fp:o:")) != -1) {
+		switch (opt) {
+		case 'v':
+			add_volume(optarg, UBI_VID_STATIC);
+			break;
+		case 'd':
+			add_volume(optarg, UBI_VID_DYNAMIC);
+			break;
+		case 'e':
+			eb_start = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nb_ebs = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			if (nb_bad == MAX_BAD)
+				fail("too many bad blocks", NULL);
+			bad[nb_bad++] = strtoul(optarg, NULL, 0);
+			break;
+		case 'O':
+			vid_hdr_offset = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0) | 1;
+			break;
+		case 'F':
+			fastmap = 1;
+			break;
+		case 'p':
+			pool_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!output || optind != argc || !nb_volumes
+	    || vid_hdr_offset % 64 || vid_hdr_offset >= PAGE_SIZE * 2)
+		usage(argv[0]);
+	if (pool_size > UBI_FM_MAX_POOL_SIZE || (pool_size && !fastmap))
+		usage(argv[0]);
+
+	data_offset = div_round_up(vid_hdr_offset + sizeof(struct ubi_vid_hdr),
+				   PAGE_SIZE) * PAGE_SIZE;
+	leb_size = PAGE_PER_BLOCK * PAGE_SIZE - data_offset;
+
+	nb_blocks = eb_start + nb_ebs;
+	image = malloc((size_t)nb_blocks * RAW_BLOCK_SIZE);
+	pebs = malloc(nb_ebs * sizeof(*pebs));
+	used = calloc(nb_ebs, 1);
+	if (!image || !pebs || !used)
+		fail("out of memory", NULL);
+	memset(image, 0xff, (size_t)nb_blocks * RAW_BLOCK_SIZE);
+
+	for (i = 0; i < nb_bad; i++) {
+		if (bad[i] >= nb_blocks)
+			fail("bad block out of range", NULL);
+		image[(size_t)bad[i] * RAW_BLOCK_SIZE
+		      + BAD_BLOCK_PAGE * RAW_PAGE_SIZE
+		      + PAGE_SIZE + BAD_BLOCK_POS] = 0;
+	}
+
+	/* Good PEBs get an EC header; the first one may hold the anchor. */
+	for (i = 0; i < nb_ebs; i++) {
+		for (j = 0; j < nb_bad && bad[j] != eb_start + i; j++)
+			;
+		if (j < nb_bad) {
+			nb_bad_in++;
+			continue;
+		}
+
+		write_ec_hdr(i);
+		if (fastmap && anchor == UBI_NO_PEB && i < UBI_FM_MAX_START)
+			anchor = i;
+		else
+			pebs[nb_free++] = i;
+	}
+
+	if (fastmap && anchor == UBI_NO_PEB)
+		fail("no room for the fastmap anchor", NULL);
+
+	for (i = nb_free; seed && i > 1; i--) {
+		uint32_t k = xorshift32(&seed) % i, tmp = pebs[i - 1];
+
+		pebs[i - 1] = pebs[k];
+		pebs[k] = tmp;
+	}
+	free_pebs = pebs;
+
+	layout->vol_id = UBI_VOL_TABLE_ID;
+	layout->vid_type = UBI_VID_DYNAMIC;
+	layout->nb_lebs = UBI_LAYOUT_VOLUME_EBS;
+	layout->size = UBI_LAYOUT_VOLUME_EBS * leb_size;
+
+	/* Keep the layout volume right after the user volumes. */
+	volumes[nb_volumes] = *layout;
+	layout = &volumes[nb_volumes];
+
+	for (i = 0; i <= nb_volumes; i++) {
+		struct volume *vol = &volumes[i];
+
+		if (vol != layout)
+			vol->nb_lebs = div_round_up(vol->size, leb_size);
+		vol->pebs = malloc(vol->nb_lebs * sizeof(uint32_t));
+		for (j = 0; j < vol->nb_lebs; j++)
+			vol->pebs[j] = UBI_NO_PEB;
+	}
+
+	write_layout_volume(layout);
+	for (i = 0; i < nb_volumes; i++) {
+		struct volume *vol = &volumes[i];
+		uint32_t skip = vol->nb_lebs < pool_size ? vol->nb_lebs
+			: pool_size;
+
+		/* The last volume keeps its last LEBs for after the fastmap */
+		write_volume(vol, 0);
+		if (i == nb_volumes - 1 && pool_size) {
+			for (j = vol->nb_lebs - skip; j < vol->nb_lebs; j++)
+				vol->pebs[j] = UBI_NO_PEB;
+			sqnum -= skip;
+			free_pebs -= skip;
+			nb_free += skip;
+			pool_size = skip;
+		}
+	}
+
+	for (i = 0; i <= nb_volumes; i++) {
+		for (j = 0; j < volumes[i].nb_lebs; j++) {
+			if (volumes[i].pebs[j] != UBI_NO_PEB)
+				used[volumes[i].pebs[j]] = 1;
+		}
+	}
+
+	if (fastmap) {
+		struct volume *last = &volumes[nb_volumes - 1];
+		uint32_t *next = free_pebs;
+
+		/* The pool holds the PEBs the last LEBs are about to go to. */
+		memcpy(pool, next, pool_size * sizeof(*pool));
+		free_pebs += pool_size;
+		nb_free -= pool_size;
+
+		write_fastmap(anchor, pool, pool_size, used, nb_bad_in);
+
+		free_pebs = next;
+		nb_free = pool_size;
+		write_volume(last, last->nb_lebs - pool_size);
+	}
+
+	f = fopen(output, "wb");
+	if (!f || fwrite(image, RAW_BLOCK_SIZE, nb_blocks, f) != nb_blocks
+	    || fclose(f))
+		fail("cannot write ", output);
+
+	printf("%u PEBs of %u bytes, LEBs of %u bytes, %u volumes%s\n",
+	       nb_ebs, PAGE_PER_BLOCK * PAGE_SIZE, leb_size, nb_volumes,
+	       fastmap ? ", fastmap" : "");
+	return 0;
+}
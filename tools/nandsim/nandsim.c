@@ -0,0 +1,1451 @@
+/*
+ * NAND boot path simulator: runs nand.c, bch-jz47x0.c, dma.c, ubi.c and
+ * uimage.c, unmodified, as a Linux program.
+ *
+ * The register windows of the EMC (NAND ports, RS decoder), BCH controller,
+ * DMAC and CPM are mapped without any access rights. Each access faults;
+ * the fault handler lets the device models prepare the value to be read,
+ * opens the page and single-steps the instruction, then picks up the value
+ * written, if any, and closes the page again. The RAM is mapped at the
+ * addresses of kseg0 and kseg1.
+ *
+ * The NAND chip is backed by a raw image with OOB data, as written by
+ * mkubi or "nanddump -o". The parity bytes of the image hold no real code:
+ * when the image is loaded, those of every programmed ECC block are
+ * replaced by a tag naming the block, which the ECC models use to find out
+ * which bits of the data they were fed are flipped.
+ *
+ * Time is modelled from the EMC timings, the chip busy times and fixed costs
+ * for register accesses and ECC decoding; the time the CPU spends computing
+ * is not.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "config.h"
+#include "jz.h"
+#include "jz4740-cpm.h"
+#include "jz4740-dmac.h"
+#include "jz4740-emc.h"
+#include "nand.h"
+#include "ubi.h"
+#include "uimage.h"
+#include "utils.h"
+
+#if (PAGE_SIZE == 512)
+#error "Small page chips are not simulated"
+#endif
+
+#define OOB_SIZE	(PAGE_SIZE / 32)
+#define RAW_PAGE_SIZE	(PAGE_SIZE + OOB_SIZE)
+#define ECC_BLOCKS	(PAGE_SIZE / ECC_BLOCK)
+
+#define NAND_BASE	0xb8000000
+#define NAND_DATA	0x0
+#define NAND_CMD	0x8000
+#define NAND_ADDR	0x10000
+
+#define BCH_BASE_ADDR	0xb30d0000
+#define BCH_BHCR	0x0
+#define BCH_BHCSR	0x4
+#define BCH_BHCCR	0x8
+#define BCH_BHCNT	0xc
+#define BCH_BHDR	0x10
+#define BCH_BHINT	0x24
+#define BCH_BHERR0	0x28
+
+#define BCH_BHCR_INIT	BIT(1)
+#define BCH_BHCR_BCHE	BIT(0)
+#define BCH_BHINT_ALL_F	BIT(4)
+#define BCH_BHINT_DECF	BIT(3)
+#define BCH_BHINT_UNCOR	BIT(1)
+#define BCH_BHINT_ERR	BIT(0)
+#define BCH_MAX_ERRORS	8
+
+#define RS_MAX_ERRORS	4
+
+/* Which ECC block of the image the parity bytes stand for */
+#define TAG_MAGIC	0x5a
+#define TAG_SIZE	6
+
+#define PS_PER_NS	1000ULL
+
+extern int serial_quiet;
+
+/* Timings in ns; see usage() */
+enum { T_R, T_RCBSY, T_RC, T_CCS, T_REG, T_ECC, NB_TIMINGS };
+
+static struct {
+	const char *name;
+	unsigned int ns;
+} timings[NB_TIMINGS] = {
+	[T_R]		= { "tR", 25000 },
+	[T_RCBSY]	= { "tRCBSY", 3000 },
+	[T_RC]		= { "tRC", 25 },
+	[T_CCS]		= { "tCCS", 100 },
+	[T_REG]		= { "reg", 30 },
+	[T_ECC]		= { "ecc", 2000 },
+};
+
+/* Shortest read cycle of the ONFI timing modes 0 to 5, in ns */
+static const unsigned int onfi_trc[] = { 100, 50, 35, 30, 25, 20 };
+
+static struct {
+	unsigned long long array_loads, cache_loads;
+	unsigned long long data_bytes, dma_bytes, reg_accesses;
+	unsigned long long ecc_blocks, ecc_erased, ecc_bits, ecc_uncor;
+	unsigned long long ecc_untagged, flips;
+	unsigned long long busy_reads, fast_reads, early_reads;
+} stats;
+
+/* Modelled time, in ps, and where it went */
+static unsigned long long now;
+static unsigned long long time_bus, time_reg, time_busy, time_ecc, time_dma;
+
+static int verbose;
+
+static void fail(const char *fmt, ...)
+{
+	va_list ap;
+
+	fflush(stdout);
+	va_start(ap, fmt);
+	fputs("nandsim: ", stderr);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+	exit(2);
+}
+
+static void wait_until(unsigned long long t, unsigned long long *account)
+{
+	if (t > now) {
+		*account += t - now;
+		now = t;
+	}
+}
+
+/*
+ * Image and bit flips
+ */
+
+static uint8_t *image;
+static uint32_t nb_pages;
+
+#define MAX_FLIPS 64
+
+static struct {
+	uint32_t page, byte;
+	uint8_t bit;
+} flips[MAX_FLIPS];
+static unsigned int nb_flips, random_flips;
+static uint32_t rand_state = 1;
+
+static uint32_t xorshift32(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static uint8_t *raw_page(uint32_t page)
+{
+	return image + (size_t)page * RAW_PAGE_SIZE;
+}
+
+static uint8_t *page_parity(uint32_t page, unsigned int block)
+{
+	return raw_page(page) + PAGE_SIZE + ECC_POS + block * PAR_SIZE;
+}
+
+static int all_ff(const uint8_t *buf, size_t len)
+{
+	while (len--) {
+		if (*buf++ != 0xff)
+			return 0;
+	}
+	return 1;
+}
+
+static void tag_image(void)
+{
+	uint32_t page;
+	unsigned int i;
+
+	for (page = 0; page < nb_pages; page++) {
+		int erased = all_ff(raw_page(page), PAGE_SIZE);
+
+		for (i = 0; i < ECC_BLOCKS; i++)
+			erased &= all_ff(page_parity(page, i), PAR_SIZE);
+		if (erased)
+			continue;
+
+		for (i = 0; i < ECC_BLOCKS; i++) {
+			uint8_t *tag = page_parity(page, i);
+
+			memset(tag, 0, PAR_SIZE);
+			tag[0] = TAG_MAGIC;
+			memcpy(tag + 1, &page, 4);
+			tag[5] = i;
+		}
+	}
+}
+
+static void mark_bad(uint32_t block)
+{
+	uint32_t page = block * PAGE_PER_BLOCK + BAD_BLOCK_PAGE;
+
+	if (page >= nb_pages)
+		fail("block %u is past the end of the image", block);
+	raw_page(page)[PAGE_SIZE + BAD_BLOCK_POS] = 0;
+}
+
+/* Fills a page register from the array, with its bit flips. */
+static void array_load(uint8_t *reg, uint32_t page)
+{
+	unsigned int i;
+
+	stats.array_loads++;
+
+	if (page >= nb_pages) {
+		memset(reg, 0xff, RAW_PAGE_SIZE);
+		return;
+	}
+
+	memcpy(reg, raw_page(page), RAW_PAGE_SIZE);
+
+	for (i = 0; i < nb_flips; i++) {
+		if (flips[i].page == page) {
+			reg[flips[i].byte] ^= 1 << flips[i].bit;
+			stats.flips++;
+		}
+	}
+
+	for (i = 0; i < random_flips; i++) {
+		uint32_t bit = xorshift32() % (PAGE_SIZE * 8);
+
+		reg[bit / 8] ^= 1 << (bit % 8);
+		stats.flips++;
+	}
+}
+
+/*
+ * Compares an ECC block with the one of the image its parity stands for.
+ * Returns the number of flipped bits, the first 'max' of which are stored
+ * to 'bits' as bit offsets, or -1 if the parity bytes are not a tag.
+ */
+static int ecc_diff(const uint8_t *data, const uint8_t *parity,
+		    uint32_t *bits, unsigned int max)
+{
+	const uint8_t *orig;
+	uint32_t page;
+	unsigned int i, j, n = 0;
+
+	if (parity[0] != TAG_MAGIC || parity[5] >= ECC_BLOCKS)
+		return -1;
+	for (i = TAG_SIZE; i < PAR_SIZE; i++) {
+		if (parity[i])
+			return -1;
+	}
+
+	memcpy(&page, parity + 1, 4);
+	if (page >= nb_pages)
+		return -1;
+
+	orig = raw_page(page) + parity[5] * ECC_BLOCK;
+	for (i = 0; i < ECC_BLOCK; i++) {
+		uint8_t diff = data[i] ^ orig[i];
+
+		for (j = 0; diff; j++, diff >>= 1) {
+			if (!(diff & 1))
+				continue;
+			if (n < max)
+				bits[n] = i * 8 + j;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+static void log_ecc(const char *what, int n)
+{
+	if (verbose)
+		fprintf(stderr, "nandsim: ECC %s (%d bits)\n", what, n);
+}
+
+/*
+ * NAND chip
+ */
+
+enum { OUT_NONE, OUT_PAGE, OUT_ID, OUT_PARAM, OUT_STATUS };
+
+#define ONFI_PARAM_SIZE	256
+#define JEDEC_PARAM_SIZE	512
+
+static struct {
+	uint8_t cmd;
+	uint8_t addr[5];
+	unsigned int nb_addr;
+	unsigned int out, col;
+	uint8_t id_addr;
+	uint32_t page;			/* page in the data register */
+	int cached;			/* output from the cache register */
+	unsigned long long ready_at;	/* R/B# goes high */
+	unsigned long long array_at;	/* array idle again */
+	unsigned long long col_at;	/* data out of the new column */
+	uint8_t data_reg[RAW_PAGE_SIZE];
+	uint8_t cache_reg[RAW_PAGE_SIZE];
+	uint8_t id[4];
+	uint8_t param[3 * JEDEC_PARAM_SIZE];
+	int onfi_mode;			/* -1 without a parameter page */
+	int jedec;			/* JEDEC page instead of ONFI */
+} chip = {
+	.id = { 0xec, 0xf1, 0x00, 0x95 },
+	.onfi_mode = -1,
+};
+
+static int rs_snoop(uint8_t val);
+
+static void put16(uint8_t *p, uint16_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t val)
+{
+	put16(p, val);
+	put16(p + 2, val >> 16);
+}
+
+static uint16_t onfi_crc16(const uint8_t *buf, size_t len)
+{
+	uint16_t crc = 0x4f4e;
+	unsigned int i;
+
+	while (len--) {
+		crc ^= *buf++ << 8;
+		for (i = 0; i < 8; i++)
+			crc = (crc << 1) ^ ((crc & 0x8000) ? 0x8005 : 0);
+	}
+
+	return crc;
+}
+
+static void onfi_init(unsigned int mode)
+{
+	uint8_t *p = chip.param;
+	unsigned int i;
+
+	memcpy(p, "ONFI", 4);
+	p[4] = 1 << 1;			/* ONFI 1.0 */
+	p[6] = BUS_WIDTH == 16;
+	p[8] = 1 << 1;			/* read cache commands */
+	memcpy(p + 32, "NANDSIM     ", 12);
+	put32(p + 80, PAGE_SIZE);
+	put16(p + 84, OOB_SIZE);
+	put32(p + 92, PAGE_PER_BLOCK);
+	put32(p + 96, nb_pages / PAGE_PER_BLOCK);
+	p[100] = 1;			/* LUNs */
+	p[101] = 2 << 4 | ROW_CYCLE;
+	p[102] = 1;			/* bits per cell */
+	put16(p + 129, (2 << mode) - 1);
+	put16(p + 137, timings[T_R].ns / 1000);
+	put16(p + 139, timings[T_CCS].ns);
+	put16(p + 254, onfi_crc16(p, 254));
+
+	for (i = 1; i < 3; i++)
+		memcpy(p + i * ONFI_PARAM_SIZE, p, ONFI_PARAM_SIZE);
+
+	chip.onfi_mode = mode;
+}
+
+/* JESD230 keeps the ONFI organization fields; the timings move. */
+static void jedec_init(unsigned int mode)
+{
+	uint8_t *p = chip.param;
+	unsigned int i;
+
+	memcpy(p, "JESD", 4);
+	p[4] = 1 << 1;			/* JESD230 1.0 */
+	p[6] = BUS_WIDTH == 16;
+	p[8] = 1 << 1;			/* read cache commands */
+	p[13] = 3;			/* parameter page copies */
+	memcpy(p + 32, "NANDSIM     ", 12);
+	put32(p + 80, PAGE_SIZE);
+	put16(p + 84, OOB_SIZE);
+	put32(p + 92, PAGE_PER_BLOCK);
+	put32(p + 96, nb_pages / PAGE_PER_BLOCK);
+	p[100] = 1;			/* LUNs */
+	p[101] = 2 << 4 | ROW_CYCLE;
+	p[102] = 1;			/* bits per cell */
+	put16(p + 144, (2 << mode) - 1);	/* asynchronous speed grades */
+	put16(p + 157, timings[T_R].ns / 1000);
+	put16(p + 161, timings[T_CCS].ns);
+	put16(p + 510, onfi_crc16(p, 510));
+
+	for (i = 1; i < 3; i++)
+		memcpy(p + i * JEDEC_PARAM_SIZE, p, JEDEC_PARAM_SIZE);
+
+	chip.onfi_mode = mode;
+	chip.jedec = 1;
+}
+
+static uint32_t chip_row(void)
+{
+	uint32_t row = chip.addr[2] | chip.addr[3] << 8;
+
+	if (ROW_CYCLE == 3)
+		row |= chip.addr[4] << 16;
+	return row;
+}
+
+static void chip_cmd(uint8_t cmd)
+{
+	unsigned long long start;
+
+	switch (cmd) {
+	case NAND_CMD_READ0:
+	case NAND_CMD_RNDOUT:
+	case NAND_CMD_READID:
+	case NAND_CMD_PARAM:
+		chip.nb_addr = 0;
+		break;
+
+	case NAND_CMD_READSTART:
+		if (chip.cmd != NAND_CMD_READ0 || chip.nb_addr != 2 + ROW_CYCLE)
+			fail("READSTART after %u address cycles", chip.nb_addr);
+		chip.page = chip_row();
+		chip.col = chip.addr[0] | chip.addr[1] << 8;
+		array_load(chip.data_reg, chip.page);
+		chip.ready_at = chip.array_at = now + timings[T_R].ns * PS_PER_NS;
+		chip.out = OUT_PAGE;
+		chip.cached = 0;
+		break;
+
+	case NAND_CMD_RNDOUTSTART:
+		if (chip.cmd != NAND_CMD_RNDOUT || chip.nb_addr != 2)
+			fail("RNDOUTSTART after %u address cycles", chip.nb_addr);
+		if (chip.out != OUT_PAGE)
+			fail("RNDOUT without a page loaded");
+		chip.col = chip.addr[0] | chip.addr[1] << 8;
+		chip.col_at = now + timings[T_CCS].ns * PS_PER_NS;
+		break;
+
+	case NAND_CMD_READCACHESEQ:
+	case NAND_CMD_READCACHEEND:
+		if (chip.out != OUT_PAGE)
+			fail("cache read without a page loaded");
+
+		/* The data register goes to the cache register as soon as
+		 * the array is idle; the next page then loads behind it. */
+		start = chip.array_at > now ? chip.array_at : now;
+		memcpy(chip.cache_reg, chip.data_reg, RAW_PAGE_SIZE);
+		chip.cached = 1;
+		chip.col = 0;
+		chip.ready_at = start + timings[T_RCBSY].ns * PS_PER_NS;
+		chip.array_at = chip.ready_at;
+
+		if (cmd == NAND_CMD_READCACHESEQ) {
+			array_load(chip.data_reg, ++chip.page);
+			stats.cache_loads++;
+			chip.array_at += timings[T_R].ns * PS_PER_NS;
+		}
+		break;
+
+	case NAND_CMD_STATUS:
+		chip.out = OUT_STATUS;
+		break;
+
+	case NAND_CMD_RESET:
+		chip.out = OUT_NONE;
+		chip.ready_at = chip.array_at = now;
+		break;
+
+	default:
+		fail("unsupported command 0x%02x", cmd);
+	}
+
+	chip.cmd = cmd;
+}
+
+static void chip_addr(uint8_t val)
+{
+	if (chip.nb_addr == sizeof(chip.addr))
+		fail("too many address cycles");
+	chip.addr[chip.nb_addr++] = val;
+
+	if (chip.cmd == NAND_CMD_READID) {
+		chip.out = OUT_ID;
+		chip.id_addr = val;
+		chip.col = 0;
+	} else if (chip.cmd == NAND_CMD_PARAM) {
+		if (chip.onfi_mode < 0)
+			fail("PARAM sent to a chip without a parameter page");
+		if (val != (chip.jedec ? 0x40 : 0x00))
+			fail("PARAM for the wrong standard (0x%02x)", val);
+		chip.out = OUT_PARAM;
+		chip.col = 0;
+		chip.ready_at = now + timings[T_R].ns * PS_PER_NS;
+	}
+}
+
+/* One byte from the data port, at time 't' */
+static uint8_t chip_read(unsigned long long t)
+{
+	uint8_t val = 0xff;
+
+	if (t < chip.ready_at)
+		stats.busy_reads++;
+
+	switch (chip.out) {
+	case OUT_PAGE:
+		if (chip.col < RAW_PAGE_SIZE)
+			val = (chip.cached ? chip.cache_reg : chip.data_reg)[chip.col];
+		chip.col++;
+		if (rs_snoop(val) < 0)
+			fail("RS decoder fed past the end of a block");
+		break;
+	case OUT_ID:
+		if (chip.id_addr == 0x20)
+			val = chip.onfi_mode < 0 || chip.jedec ? 0
+				: "ONFI"[chip.col++ % 4];
+		else if (chip.id_addr == 0x40)
+			val = !chip.jedec ? 0 : "JEDEC"[chip.col++ % 5];
+		else
+			val = chip.id[chip.col++ % sizeof(chip.id)];
+		break;
+	case OUT_PARAM:
+		if (chip.col < sizeof(chip.param))
+			val = chip.param[chip.col++];
+		break;
+	case OUT_STATUS:
+		val = (t < chip.ready_at ? 0 : NAND_STATUS_READY
+		       | NAND_STATUS_TRUE_READY) | NAND_STATUS_WP;
+		break;
+	default:
+		fail("data read without a command");
+	}
+
+	return val;
+}
+
+/* A data port access; page data come 16 bits at a time on a 16-bit bus. */
+static uint32_t chip_read_port(unsigned long long t)
+{
+	uint32_t val;
+
+	if (chip.out == OUT_PAGE && t < chip.col_at)
+		stats.early_reads++;
+
+	val = chip_read(t);
+
+	if (BUS_WIDTH == 16 && chip.out == OUT_PAGE)
+		val |= chip_read(t) << 8;
+	return val;
+}
+
+/*
+ * Clocks and EMC timings
+ */
+
+static uint32_t cpm_regs[0x400];
+static uint32_t emc_regs[0x400];
+
+static unsigned int mclk(void)
+{
+	static const unsigned int div[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32 };
+	uint32_t cppcr = cpm_regs[(CPM_CPPCR - CPM_BASE) / 4];
+	uint32_t cpccr = cpm_regs[(CPM_CPCCR - CPM_BASE) / 4];
+	static const unsigned int od[4] = { 1, 2, 2, 4 };
+	unsigned int pll = CFG_EXTAL, mdiv;
+
+	if ((cppcr & CPM_CPPCR_PLLEN) && !(cppcr & CPM_CPPCR_PLLBP)) {
+		pll = CFG_EXTAL / (((cppcr & CPM_CPPCR_PLLN_MASK)
+				    >> CPM_CPPCR_PLLN_BIT) + 2)
+			/ od[(cppcr & CPM_CPPCR_PLLOD_MASK) >> CPM_CPPCR_PLLOD_BIT]
+			* (((cppcr & CPM_CPPCR_PLLM_MASK)
+			    >> CPM_CPPCR_PLLM_BIT) + 2);
+	}
+
+	mdiv = (cpccr & CPM_CPCCR_MDIV_MASK) >> CPM_CPCCR_MDIV_BIT;
+	return pll / div[mdiv < ARRAY_SIZE(div) ? mdiv : 0];
+}
+
+/*
+ * One access to the NAND ports, in ps. The EMC cycle is taken to be
+ * TAS + TAW + TAH + 1 MCLK cycles, then STRV cycles of recovery.
+ */
+static unsigned long long emc_cycle(void)
+{
+	static const unsigned int taw_cycles[16] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 15, 20, 25, 31,
+	};
+	uint32_t smcr = emc_regs[(EMC_SMCR1 - EMC_BASE) / 4];
+	unsigned int cycles = 1
+		+ ((smcr & EMC_SMCR_TAS_MASK) >> EMC_SMCR_TAS_BIT)
+		+ taw_cycles[(smcr & EMC_SMCR_TAW_MASK) >> EMC_SMCR_TAW_BIT]
+		+ ((smcr & EMC_SMCR_TAH_MASK) >> EMC_SMCR_TAH_BIT)
+		+ ((smcr & EMC_SMCR_STRV_MASK) >> EMC_SMCR_STRV_BIT);
+	unsigned long long ps = cycles * 1000000000000ULL / mclk();
+	unsigned int trc = chip.onfi_mode < 0 ? timings[T_RC].ns
+			   : onfi_trc[chip.onfi_mode];
+
+	if (ps < trc * PS_PER_NS)
+		stats.fast_reads++;
+	return ps;
+}
+
+/*
+ * Device models: 'read' returns the value of a register, with the side
+ * effects of a read unless 'peek' is set; 'width' tells the size of the
+ * register at an offset.
+ */
+struct device {
+	const char *name;
+	uint32_t base, size;
+	uint32_t (*read)(uint32_t reg, int peek);
+	void (*write)(uint32_t reg, uint32_t val);
+	unsigned int (*width)(uint32_t reg);
+};
+
+static unsigned int width32(uint32_t reg)
+{
+	(void)reg;
+	return 4;
+}
+
+static void check_enabled(void)
+{
+	if (!(emc_regs[(EMC_NFCSR - EMC_BASE) / 4] & EMC_NFCSR_NFCE1))
+		fail("NAND port accessed with the chip deselected");
+}
+
+static uint32_t nand_read(uint32_t reg, int peek)
+{
+	if (peek || reg != NAND_DATA)
+		return 0;
+
+	check_enabled();
+	return chip_read_port(now);
+}
+
+static void nand_write(uint32_t reg, uint32_t val)
+{
+	check_enabled();
+
+	if (reg == NAND_CMD)
+		chip_cmd(val);
+	else if (reg == NAND_ADDR)
+		chip_addr(val);
+	else
+		fail("write to the data port");
+}
+
+static unsigned int nand_width(uint32_t reg)
+{
+	return reg == NAND_DATA ? BUS_WIDTH / 8 : 1;
+}
+
+/* RS decoder of the JZ4740; it snoops the data read from the NAND. */
+#if JZ_VERSION == 4740
+#define EMC_REG(addr)	emc_regs[((addr) - EMC_BASE) / 4]
+
+static struct {
+	int snoop;
+	unsigned int count;
+	uint8_t buf[ECC_BLOCK];
+	uint8_t parity[PAR_SIZE];
+	unsigned long long done_at;
+} rs;
+
+static int rs_snoop(uint8_t val)
+{
+	if (!rs.snoop)
+		return 0;
+	if (rs.count == ECC_BLOCK)
+		return -1;
+
+	rs.buf[rs.count++] = val;
+	return 0;
+}
+
+static void rs_decode(void)
+{
+	uint32_t bits[64], syms[RS_MAX_ERRORS + 1], masks[RS_MAX_ERRORS + 1];
+	unsigned int i, j, nb_syms = 0;
+	uint32_t ints = EMC_NFINTS_DECF;
+	int n;
+
+	if (rs.count != ECC_BLOCK)
+		fail("RS decoding after %u bytes", rs.count);
+
+	stats.ecc_blocks++;
+	n = ecc_diff(rs.buf, rs.parity, bits, ARRAY_SIZE(bits));
+
+	for (i = 0; n > 0 && i < (unsigned int)n && i < ARRAY_SIZE(bits); i++) {
+		uint32_t sym = bits[i] / 9;
+
+		for (j = 0; j < nb_syms && syms[j] != sym; j++)
+			;
+		if (j == nb_syms) {
+			if (nb_syms == RS_MAX_ERRORS + 1)
+				break;
+			syms[nb_syms] = sym;
+			masks[nb_syms++] = 0;
+		}
+		masks[j] |= 1 << (bits[i] % 9);
+	}
+
+	if (n < 0) {
+		stats.ecc_untagged++;
+		ints |= EMC_NFINTS_ERR | EMC_NFINTS_UNCOR;
+		log_ecc("parity not recognised", n);
+	} else if (nb_syms > RS_MAX_ERRORS || n > (int)ARRAY_SIZE(bits)) {
+		stats.ecc_uncor++;
+		ints |= EMC_NFINTS_ERR | EMC_NFINTS_UNCOR;
+		log_ecc("uncorrectable", n);
+	} else if (n) {
+		stats.ecc_bits += n;
+		ints |= EMC_NFINTS_ERR | nb_syms << EMC_NFINTS_ERRCNT_BIT;
+		for (i = 0; i < nb_syms; i++)
+			EMC_REG(EMC_NFERR0 + i * 4) =
+				(syms[i] + 1) << EMC_NFERR_INDEX_BIT | masks[i];
+		log_ecc("corrected", n);
+	}
+
+	EMC_REG(EMC_NFINTS) = ints;
+	rs.done_at = now + timings[T_ECC].ns * PS_PER_NS;
+}
+#else
+static int rs_snoop(uint8_t val)
+{
+	(void)val;
+	return 0;
+}
+#endif
+
+static uint32_t emc_read(uint32_t reg, int peek)
+{
+#if JZ_VERSION == 4740
+	if (!peek && reg == EMC_NFINTS - EMC_BASE)
+		wait_until(rs.done_at, &time_ecc);
+#else
+	(void)peek;
+#endif
+	return emc_regs[reg / 4];
+}
+
+static void emc_write(uint32_t reg, uint32_t val)
+{
+#if JZ_VERSION == 4740
+	uint32_t par = reg - (EMC_NFPAR0 - EMC_BASE);
+
+	if (par < PAR_SIZE) {
+		rs.parity[par] = val;
+		return;
+	}
+
+	if (reg == EMC_NFECR - EMC_BASE) {
+		if (val & EMC_NFECR_ERST)
+			rs.count = 0;
+		rs.snoop = !!(val & EMC_NFECR_ECCE);
+		if (val & EMC_NFECR_PRDY)
+			rs_decode();
+
+		/* Both bits clear themselves. */
+		val &= ~(EMC_NFECR_ERST | EMC_NFECR_PRDY);
+	}
+#endif
+	emc_regs[reg / 4] = val;
+}
+
+static unsigned int emc_width(uint32_t reg)
+{
+	uint32_t par = reg - (EMC_NFPAR0 - EMC_BASE);
+
+	return JZ_VERSION == 4740 && par < PAR_SIZE ? 1 : 4;
+}
+
+/* BCH controller of the JZ4750; the data is written to BHDR. */
+static uint32_t bch_regs[0x400];
+static unsigned int bch_count;
+static uint8_t bch_buf[ECC_BLOCK + PAR_SIZE];
+static unsigned long long bch_done_at;
+static int bch_pending;
+
+static void bch_decode(void)
+{
+	uint32_t bits[BCH_MAX_ERRORS + 1] = { 0 };
+	uint32_t hint = BCH_BHINT_DECF;
+	unsigned int i;
+	int n;
+
+	stats.ecc_blocks++;
+
+	if (all_ff(bch_buf, sizeof(bch_buf))) {
+		stats.ecc_erased++;
+		hint |= BCH_BHINT_ALL_F;
+		n = 0;
+	} else {
+		n = ecc_diff(bch_buf, bch_buf + ECC_BLOCK, bits,
+			     ARRAY_SIZE(bits));
+	}
+
+	if (n < 0) {
+		stats.ecc_untagged++;
+		hint |= BCH_BHINT_ERR | BCH_BHINT_UNCOR;
+		log_ecc("parity not recognised", n);
+	} else if (n > BCH_MAX_ERRORS) {
+		stats.ecc_uncor++;
+		hint |= BCH_BHINT_ERR | BCH_BHINT_UNCOR;
+		log_ecc("uncorrectable", n);
+	} else if (n) {
+		stats.ecc_bits += n;
+		hint |= BCH_BHINT_ERR | n << 28;
+		for (i = 0; i < BCH_MAX_ERRORS / 2; i++)
+			bch_regs[BCH_BHERR0 / 4 + i] =
+				bits[2 * i] | bits[2 * i + 1] << 16;
+		log_ecc("corrected", n);
+	}
+
+	bch_regs[BCH_BHINT / 4] |= hint;
+	bch_done_at = now + timings[T_ECC].ns * PS_PER_NS;
+	bch_pending = 1;
+}
+
+static uint32_t bch_read(uint32_t reg, int peek)
+{
+	if (!peek && reg == BCH_BHINT && bch_pending) {
+		wait_until(bch_done_at, &time_ecc);
+		bch_pending = 0;
+	}
+
+	return bch_regs[reg / 4];
+}
+
+static void bch_write(uint32_t reg, uint32_t val)
+{
+	uint32_t *bhcr = &bch_regs[BCH_BHCR / 4];
+
+	switch (reg) {
+	case BCH_BHCSR:
+		*bhcr |= val;
+		if (val & BCH_BHCR_INIT) {
+			bch_count = 0;
+			*bhcr &= ~BCH_BHCR_INIT;
+		}
+		break;
+	case BCH_BHCCR:
+		*bhcr &= ~val;
+		break;
+	case BCH_BHINT:
+		bch_regs[reg / 4] &= ~val;
+		break;
+	case BCH_BHDR:
+		if (!(*bhcr & BCH_BHCR_BCHE))
+			fail("BCH fed while disabled");
+		if (bch_count == ECC_BLOCK + PAR_SIZE)
+			fail("BCH fed past the end of a block");
+		bch_buf[bch_count++] = val;
+		if (bch_count == ((bch_regs[BCH_BHCNT / 4] >> 16) & 0x3ff))
+			bch_decode();
+		break;
+	default:
+		bch_regs[reg / 4] = val;
+	}
+}
+
+static unsigned int bch_width(uint32_t reg)
+{
+	return reg == BCH_BHDR ? 1 : 4;
+}
+
+/* DMAC: only transfers from the NAND data port are supported. */
+static uint32_t dmac_regs[0x400];
+static unsigned long long dma_done_at;
+static uint32_t ram_size = 32 << 20;
+
+#define DMAC_REG(addr)	dmac_regs[((addr) - DMAC_BASE) / 4]
+
+static void dma_run(void)
+{
+	uint32_t cmd = DMAC_REG(DMAC_DCMD(0)), src = DMAC_REG(DMAC_DSAR(0));
+	uint32_t dst = DMAC_REG(DMAC_DTAR(0));
+	uint32_t len = DMAC_REG(DMAC_DTCR(0)) * 4, i;
+	unsigned long long t = dma_done_at > now ? dma_done_at : now;
+	uint8_t *buf = (uint8_t *)KSEG1ADDR(dst);
+
+	if (src != PHYSADDR(NAND_BASE) || (cmd & DMAC_DCMD_SAI)
+	    || (cmd & 7 << DMAC_DCMD_DS_BIT) != DMAC_DCMD_DS_32BIT
+	    || dst + len > ram_size || dst + len < dst) {
+		DMAC_REG(DMAC_DCCSR(0)) |= DMAC_DCCSR_AR;
+		return;
+	}
+
+	check_enabled();
+
+	for (i = 0; i < len; i += BUS_WIDTH / 8) {
+		uint32_t val = chip_read_port(t);
+
+		memcpy(buf + i, &val, BUS_WIDTH / 8);
+		t += emc_cycle();
+	}
+
+	stats.dma_bytes += len;
+	dma_done_at = t;
+	DMAC_REG(DMAC_DTCR(0)) = 0;
+	DMAC_REG(DMAC_DCCSR(0)) |= DMAC_DCCSR_TT;
+}
+
+static uint32_t dmac_read(uint32_t reg, int peek)
+{
+	if (!peek && reg == DMAC_DCCSR(0) - DMAC_BASE)
+		wait_until(dma_done_at, &time_dma);
+
+	return dmac_regs[reg / 4];
+}
+
+static void dmac_write(uint32_t reg, uint32_t val)
+{
+	dmac_regs[reg / 4] = val;
+
+	if (reg == DMAC_DCCSR(0) - DMAC_BASE && (val & DMAC_DCCSR_EN)
+	    && (DMAC_REG(DMAC_DMACR) & DMAC_DMACR_DMAE))
+		dma_run();
+}
+
+static uint32_t cpm_read(uint32_t reg, int peek)
+{
+	(void)peek;
+	return cpm_regs[reg / 4];
+}
+
+static void cpm_write(uint32_t reg, uint32_t val)
+{
+	cpm_regs[reg / 4] = val;
+}
+
+static struct device devices[] = {
+	{ "NAND", NAND_BASE, 0x11000, nand_read, nand_write, nand_width },
+	{ "EMC", EMC_BASE, 0x1000, emc_read, emc_write, emc_width },
+	{ "BCH", BCH_BASE_ADDR, 0x1000, bch_read, bch_write, bch_width },
+	{ "DMAC", DMAC_BASE, 0x1000, dmac_read, dmac_write, width32 },
+	{ "CPM", CPM_BASE, 0x1000, cpm_read, cpm_write, width32 },
+};
+
+/*
+ * Register access trapping
+ */
+
+#define X86_EFLAGS_TF	0x100
+
+/* Polls of a status register that never comes right would hang forever. */
+#define MAX_POLLS	1000000
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE	0x100000
+#endif
+
+static long page_size;
+
+static struct {
+	struct device *dev;
+	uint32_t addr;
+	unsigned int width;
+	int write;
+} trap;
+
+static void *page_of(uint32_t addr)
+{
+	return (void *)(addr & ~(page_size - 1));
+}
+
+static void on_segv(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+	static uint32_t last_addr, polls;
+	uint32_t addr = (uint32_t)si->si_addr, val;
+	struct device *dev = NULL;
+	unsigned int i;
+
+	(void)sig;
+
+	for (i = 0; i < ARRAY_SIZE(devices); i++) {
+		if (addr - devices[i].base < devices[i].size)
+			dev = &devices[i];
+	}
+
+	if (!dev || trap.dev) {
+		/* A real crash: let it happen again, without this handler. */
+		signal(SIGSEGV, SIG_DFL);
+		return;
+	}
+
+	if (addr == last_addr && !(uc->uc_mcontext.gregs[REG_ERR] & 2)) {
+		if (++polls == MAX_POLLS)
+			fail("stuck polling %s register 0x%x", dev->name,
+			     addr - dev->base);
+	} else {
+		polls = 0;
+	}
+	last_addr = addr;
+
+	trap.dev = dev;
+	trap.width = dev->width(addr - dev->base);
+	trap.addr = addr & ~(trap.width - 1);
+	trap.write = uc->uc_mcontext.gregs[REG_ERR] & 2;
+
+	if (dev == &devices[0]) {
+		unsigned long long cycle = emc_cycle();
+
+		now += cycle;
+		time_bus += cycle;
+		if (!trap.write)
+			stats.data_bytes += trap.width;
+	} else {
+		now += timings[T_REG].ns * PS_PER_NS;
+		time_reg += timings[T_REG].ns * PS_PER_NS;
+		stats.reg_accesses++;
+	}
+
+	/* Writes may be read-modify-writes: the register is always loaded. */
+	val = dev->read(trap.addr - dev->base, trap.write);
+
+	mprotect(page_of(addr), page_size, PROT_READ | PROT_WRITE);
+	memcpy((void *)trap.addr, &val, trap.width);
+	uc->uc_mcontext.gregs[REG_EFL] |= X86_EFLAGS_TF;
+}
+
+static void on_trap(int sig, siginfo_t *si, void *ctx)
+{
+	ucontext_t *uc = ctx;
+	struct device *dev = trap.dev;
+	uint32_t val = 0;
+
+	(void)sig;
+	(void)si;
+
+	uc->uc_mcontext.gregs[REG_EFL] &= ~X86_EFLAGS_TF;
+	if (!dev)
+		return;
+
+	memcpy(&val, (void *)trap.addr, trap.width);
+	mprotect(page_of(trap.addr), page_size, PROT_NONE);
+	trap.dev = NULL;
+
+	if (trap.write)
+		dev->write(trap.addr - dev->base, val);
+}
+
+static void map_fixed(uint32_t addr, size_t size, int prot, int flags, int fd)
+{
+	void *ptr = mmap((void *)addr, size, prot,
+			 flags | MAP_FIXED_NOREPLACE, fd, 0);
+
+	if (ptr != (void *)addr)
+		fail("cannot map 0x%08x: %m", addr);
+}
+
+static void setup_memory(void)
+{
+	struct sigaction sa = { .sa_flags = SA_SIGINFO };
+	unsigned int i;
+	int fd;
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	/* The same RAM, cached and uncached */
+	fd = memfd_create("ram", 0);
+	if (fd < 0 || ftruncate(fd, ram_size))
+		fail("cannot allocate the RAM: %m");
+	map_fixed(KSEG0, ram_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd);
+	map_fixed(KSEG1, ram_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd);
+	close(fd);
+
+	for (i = 0; i < ARRAY_SIZE(devices); i++)
+		map_fixed(devices[i].base, devices[i].size, PROT_NONE,
+			  MAP_PRIVATE | MAP_ANONYMOUS, -1);
+
+	sa.sa_sigaction = on_segv;
+	sigaction(SIGSEGV, &sa, NULL);
+	sa.sa_sigaction = on_trap;
+	sigaction(SIGTRAP, &sa, NULL);
+}
+
+/* Registers as left by the board code: PLL at CFG_CPU_SPEED, MCLK / 3 */
+static void setup_clocks(void)
+{
+	cpm_regs[(CPM_CPPCR - CPM_BASE) / 4] = CPM_CPPCR_PLLEN
+		| (2 * (CFG_CPU_SPEED / CFG_EXTAL) - 2) << CPM_CPPCR_PLLM_BIT;
+	cpm_regs[(CPM_CPCCR - CPM_BASE) / 4] = 2 << CPM_CPCCR_MDIV_BIT;
+
+	/* Reset value: the slowest timings */
+	emc_regs[(EMC_SMCR1 - EMC_BASE) / 4] = 0x0fff7700;
+}
+
+/*
+ * Board functions
+ */
+
+void nand_init(void)
+{
+#ifdef BOARD_a320
+	REG_EMC_SMCR1 = 0x094c4400;
+#else
+	REG_EMC_SMCR1 = (EMC_TAS << EMC_SMCR_TAS_BIT) |
+			(EMC_TAH << EMC_SMCR_TAH_BIT) |
+			(EMC_TBP << EMC_SMCR_TBP_BIT) |
+			(EMC_TAW << EMC_SMCR_TAW_BIT) |
+			(EMC_STRV << EMC_SMCR_STRV_BIT);
+#endif
+}
+
+/* R/B# is a GPIO on the boards; here, just wait for the chip. */
+void nand_wait_ready(void)
+{
+	wait_until(chip.ready_at, &time_busy);
+}
+
+unsigned int get_memory_size(void)
+{
+	return ram_size;
+}
+
+void udelay(unsigned int us)
+{
+	now += us * 1000 * PS_PER_NS;
+}
+
+void ndelay(unsigned int ns)
+{
+	now += ns * PS_PER_NS;
+}
+
+/*
+ * Checks of what was loaded
+ */
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *buf;
+	long len;
+
+	if (!f || fseek(f, 0, SEEK_END) || (len = ftell(f)) < 0)
+		fail("cannot read %s: %m", path);
+	rewind(f);
+
+	buf = malloc(len + 1);
+	if (!buf || fread(buf, 1, len, f) != (size_t)len)
+		fail("cannot read %s: %m", path);
+
+	fclose(f);
+	*size = len;
+	return buf;
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int compare(const char *what, const void *ram, const void *file,
+		   size_t len)
+{
+	const uint8_t *a = ram, *b = file;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (a[i] != b[i]) {
+			fprintf(stderr, "nandsim: %s differs at offset 0x%zx\n",
+				what, i);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int check_kernel(const char *path, void *exec_addr)
+{
+	size_t size;
+	uint8_t *buf = read_file(path, &size);
+	uint32_t entry, off, i;
+	int ret = 0;
+
+	if (size >= 64 && get_be32(buf) == 0x27051956) {
+		uint32_t len = get_be32(buf + 12);
+
+		if (64 + len > size)
+			fail("%s: truncated uImage", path);
+		entry = get_be32(buf + 20);
+		ret = compare("kernel", (void *)KSEG1ADDR(get_be32(buf + 16)),
+			      buf + 64, len);
+	} else if (size >= 52 && get_le32(buf) == 0x464c457f) {
+		entry = get_le32(buf + 24);
+		off = get_le32(buf + 28);
+
+		for (i = 0; i < (uint32_t)(buf[44] | buf[45] << 8); i++) {
+			const uint8_t *ph = buf + off + i * 32;
+			uint8_t *dst = (uint8_t *)KSEG1ADDR(get_le32(ph + 12));
+			uint32_t filesz = get_le32(ph + 16);
+			uint32_t memsz = get_le32(ph + 20);
+
+			if (get_le32(ph) != 1)
+				continue;
+			ret |= compare("kernel segment", dst,
+				       buf + get_le32(ph + 4), filesz);
+			for (; filesz < memsz; filesz++) {
+				if (dst[filesz]) {
+					fprintf(stderr, "nandsim: BSS not cleared\n");
+					ret = -1;
+					break;
+				}
+			}
+		}
+	} else {
+		fail("%s: not a uImage or ELF kernel", path);
+	}
+
+	if (entry != (uint32_t)exec_addr) {
+		fprintf(stderr, "nandsim: entry point 0x%08x, expected 0x%08x\n",
+			(uint32_t)exec_addr, entry);
+		ret = -1;
+	}
+
+	free(buf);
+	return ret;
+}
+
+static int check_blob(const char *what, const char *path, const void *addr,
+		      uint32_t loaded_size)
+{
+	size_t size;
+	uint8_t *buf = read_file(path, &size);
+	int ret;
+
+	if (!addr) {
+		fprintf(stderr, "nandsim: no %s was loaded\n", what);
+		ret = -1;
+	} else if (loaded_size && loaded_size != size) {
+		fprintf(stderr, "nandsim: %s is %u bytes, expected %zu\n",
+			what, loaded_size, size);
+		ret = -1;
+	} else {
+		ret = compare(what, addr, buf, size);
+	}
+
+	free(buf);
+	return ret;
+}
+
+static double ms(unsigned long long ps)
+{
+	return ps / 1e9;
+}
+
+static void report(void)
+{
+	printf("\nModelled time      %10.3f ms\n", ms(now));
+	printf("  NAND bus cycles  %10.3f ms\n", ms(time_bus));
+	printf("  chip busy        %10.3f ms\n", ms(time_busy));
+	printf("  ECC decoding     %10.3f ms\n", ms(time_ecc));
+	printf("  DMA waits        %10.3f ms\n", ms(time_dma));
+	printf("  register access  %10.3f ms\n", ms(time_reg));
+	printf("Page loads         %10llu (%llu by cache reads)\n",
+	       stats.array_loads, stats.cache_loads);
+	printf("Bytes read         %10llu (%llu by DMA)\n",
+	       stats.data_bytes + stats.dma_bytes, stats.dma_bytes);
+	printf("Register accesses  %10llu\n", stats.reg_accesses);
+	printf("ECC blocks         %10llu (%llu erased)\n",
+	       stats.ecc_blocks, stats.ecc_erased);
+	printf("  bit flips        %10llu injected, %llu reported\n",
+	       stats.flips, stats.ecc_bits);
+	printf("  uncorrectable    %10llu\n", stats.ecc_uncor);
+	if (stats.ecc_untagged)
+		printf("  unknown parity   %10llu\n", stats.ecc_untagged);
+	if (stats.busy_reads)
+		printf("Reads while busy   %10llu\n", stats.busy_reads);
+	if (stats.fast_reads)
+		printf("Cycles below tRC   %10llu\n", stats.fast_reads);
+	if (stats.early_reads)
+		printf("Reads before tCCS  %10llu\n", stats.early_reads);
+}
+
+static void usage(const char *name)
+{
+	unsigned int i;
+
+	fprintf(stderr, "Usage: %s [options] IMAGE\n\n"
+		"IMAGE is a raw dump of the NAND, OOB data included.\n\n"
+		"  -a          load the backup volumes\n"
+		"  -b BLOCK    mark BLOCK bad\n"
+		"  -f P:B:N    flip bit N of byte B of page P on every read\n"
+		"  -r N        flip N random data bits on every page load\n"
+		"  -s SEED     seed for the random bit flips\n"
+		"  -o MODE     answer ONFI probes, with timing modes up to MODE\n"
+		"  -j MODE     answer JEDEC probes, with speed grades up to MODE\n"
+		"  -t NAME=NS  change a timing, in ns:", name);
+	for (i = 0; i < NB_TIMINGS; i++)
+		fprintf(stderr, " %s=%u", timings[i].name, timings[i].ns);
+	fprintf(stderr, "\n"
+		"  -m MB       RAM size (default: %u)\n"
+		"  -K FILE     check the kernel against this uImage or ELF file\n"
+		"  -I FILE     check the initramfs against this file\n"
+		"  -D FILE     check the device tree against this file\n"
+		"  -q          don't print the bootloader output\n"
+		"  -v          log ECC events\n", ram_size >> 20);
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *kernel = NULL, *initrd = NULL, *fdt = NULL;
+	uint32_t bad[64];
+	unsigned int i, nb_bad = 0, alt = 0;
+	void *exec_addr = NULL;
+	int opt, onfi = -1, jedec = 0, ret;
+	size_t size;
+
+	while ((opt = getopt(argc, argv, "ab:f:r:s:o:j:t:m:K:I:D:qv")) != -1) {
+		switch (opt) {
+		case 'a':
+			alt = 1;
+			break;
+		case 'b':
+			if (nb_bad == ARRAY_SIZE(bad))
+				fail("too many bad blocks");
+			bad[nb_bad++] = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			if (nb_flips == MAX_FLIPS
+			    || sscanf(optarg, "%u:%u:%hhu", &flips[nb_flips].page,
+				      &flips[nb_flips].byte,
+				      &flips[nb_flips].bit) != 3
+			    || flips[nb_flips].byte >= RAW_PAGE_SIZE
+			    || flips[nb_flips].bit > 7)
+				usage(argv[0]);
+			nb_flips++;
+			break;
+		case 'r':
+			random_flips = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			rand_state = strtoul(optarg, NULL, 0) | 1;
+			break;
+		case 'o':
+		case 'j':
+			jedec = opt == 'j';
+			onfi = strtoul(optarg, NULL, 0);
+			if (onfi >= (int)ARRAY_SIZE(onfi_trc))
+				usage(argv[0]);
+			break;
+		case 't':
+			for (i = 0; i < NB_TIMINGS; i++) {
+				size_t len = strlen(timings[i].name);
+
+				if (!strncmp(optarg, timings[i].name, len)
+				    && optarg[len] == '=') {
+					timings[i].ns = strtoul(optarg + len + 1,
+								NULL, 0);
+					break;
+				}
+			}
+			if (i == NB_TIMINGS)
+				usage(argv[0]);
+			break;
+		case 'm':
+			ram_size = strtoul(optarg, NULL, 0) << 20;
+			break;
+		case 'K':
+			kernel = optarg;
+			break;
+		case 'I':
+			initrd = optarg;
+			break;
+		case 'D':
+			fdt = optarg;
+			break;
+		case 'q':
+			serial_quiet = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	image = read_file(argv[optind], &size);
+	if (!size || size % (PAGE_PER_BLOCK * RAW_PAGE_SIZE))
+		fail("%s is not a whole number of blocks with OOB data",
+		     argv[optind]);
+	nb_pages = size / RAW_PAGE_SIZE;
+
+	tag_image();
+	for (i = 0; i < nb_bad; i++)
+		mark_bad(bad[i]);
+	if (jedec)
+		jedec_init(onfi);
+	else if (onfi >= 0)
+		onfi_init(onfi);
+
+	setup_memory();
+	setup_clocks();
+
+	nand_init();
+#ifdef USE_NAND_ONFI
+	nand_detect();
+#endif
+	ret = ubi_load_kernel(&exec_addr, alt);
+
+	fflush(stdout);
+	if (ret) {
+		fprintf(stderr, "nandsim: loading failed\n");
+	} else {
+		printf("\nKernel entry point 0x%08x\n", (uint32_t)exec_addr);
+		if (boot_initrd)
+			printf("Initramfs at 0x%08x, %u bytes\n",
+			       (uint32_t)boot_initrd, boot_initrd_size);
+		if (boot_fdt)
+			printf("Device tree at 0x%08x\n", (uint32_t)boot_fdt);
+
+		if (kernel)
+			ret |= check_kernel(kernel, exec_addr);
+		if (initrd)
+			ret |= check_blob("initramfs", initrd, boot_initrd,
+					  boot_initrd_size);
+		if (fdt)
+			ret |= check_blob("device tree", fdt, boot_fdt, 0);
+	}
+
+	report();
+
+	if (stats.busy_reads || stats.fast_reads || stats.early_reads
+	    || stats.ecc_untagged)
+		ret = -1;
+	return ret ? 1 : 0;
+}